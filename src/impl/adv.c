@@ -0,0 +1,270 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+#include <zephyr/bluetooth/uuid.h>
+
+#include "adv.h"
+#include "ble.h"
+#include "cycle.h"
+#include "vbat.h"
+#include "stats.h"
+#include "schedule_queue.h"
+
+LOG_MODULE_REGISTER(adv, LOG_LEVEL_INF);
+
+#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+
+#define ADV_RETRY_MS 1000u /* start failed (e.g. conn object not yet recycled) */
+
+struct phase_cfg
+{
+    uint16_t int_min;
+    uint16_t int_max;
+    uint32_t duration_ms; /* 0 = stay */
+    const char *name;
+};
+
+static const struct phase_cfg phase_cfg[ADV_PHASE_COUNT] = {
+    [ADV_PHASE_OFF] = {0, 0, 0, "off"},
+    [ADV_PHASE_FAST] = {ADV_FAST_INT_MIN, ADV_FAST_INT_MAX, ADV_FAST_MS, "fast"},
+    [ADV_PHASE_SLOW] = {ADV_SLOW_INT_MIN, ADV_SLOW_INT_MAX, ADV_SLOW_MS, "slow"},
+    [ADV_PHASE_BEACON] = {ADV_BEACON_INT_MIN, ADV_BEACON_INT_MAX, 0, "beacon"},
+};
+
+/* Only touched from the system workqueue (status and start work) */
+static uint8_t mfg[ADV_MFG_LEN] = {
+    ADV_MFG_COMPANY_ID & 0xFF, ADV_MFG_COMPANY_ID >> 8, ADV_MFG_VERSION};
+
+static const struct bt_data ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg, sizeof(mfg)),
+};
+
+BUILD_ASSERT(3 + (2 + DEVICE_NAME_LEN) + (2 + ADV_MFG_LEN) <= 31,
+             "advertising data exceeds 31 bytes; shorten CONFIG_BT_DEVICE_NAME");
+
+static const struct bt_data sd[] = {
+    BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_MACHHAR_SERVICE_VAL),
+};
+
+static bool is_advertising = false;
+
+/* Phase state is owned by phase_work (system workqueue); other contexts
+ * only post requests and kick it.
+ */
+enum
+{
+    REQ_WAKE,
+};
+
+static ATOMIC_DEFINE(reqs, 1);
+static atomic_t n_conn;    /* live connections */
+static atomic_t new_conns; /* connections not yet accounted by phase_work */
+static enum adv_phase phase = ADV_PHASE_OFF;
+static uint32_t phase_since;
+static uint32_t phase_deadline; /* valid when the phase has a duration */
+static struct adv_phase_stats phase_stats[ADV_PHASE_COUNT];
+
+/* Defined statically so producers that run before bt_enable() (battery
+ * sampling, RTC alarm, button, stats logging) can already submit them; the
+ * handlers do nothing until the stack is up and adv_start() kicks both.
+ */
+static void phase_work_handler(struct k_work *work);
+static void status_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(phase_work, phase_work_handler);
+static K_WORK_DEFINE(status_work, status_work_handler);
+
+static void enter_phase(enum adv_phase next)
+{
+    const uint32_t now = k_uptime_get_32();
+
+    if (phase != ADV_PHASE_OFF)
+    {
+        phase_stats[phase].ms += now - phase_since;
+        if (is_advertising)
+        {
+            int err = bt_le_adv_stop();
+            if (err && err != -EALREADY)
+            {
+                LOG_WRN("bt_le_adv_stop err %d", err);
+            }
+        }
+    }
+
+    is_advertising = false;
+    phase = next;
+    phase_since = now;
+
+    if (next == ADV_PHASE_OFF)
+        return;
+
+    const struct phase_cfg *pc = &phase_cfg[next];
+    const struct bt_le_adv_param *param = BT_LE_ADV_PARAM(
+        (BT_LE_ADV_OPT_CONN | BT_LE_ADV_OPT_USE_IDENTITY),
+        pc->int_min, pc->int_max, NULL);
+
+    int err = bt_le_adv_start(param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+    if (err)
+    {
+        LOG_ERR("bt_le_adv_start (%s) err %d", pc->name, err);
+        phase = ADV_PHASE_OFF;
+        atomic_set_bit(reqs, REQ_WAKE);
+        return;
+    }
+
+    is_advertising = true;
+    phase_stats[next].entered++;
+    LOG_INF("Advertising: %s phase (%u-%u)", pc->name, pc->int_min, pc->int_max);
+
+    phase_deadline = now + pc->duration_ms;
+}
+
+static void phase_work_handler(struct k_work *work)
+{
+    if (!bt_is_ready())
+        return; /* REQ_WAKE stays posted for adv_start() */
+
+    const atomic_val_t joined = atomic_set(&new_conns, 0);
+    if (joined > 0)
+    {
+        if (phase != ADV_PHASE_OFF)
+        {
+            phase_stats[phase].connections += (uint32_t)joined;
+            LOG_INF("Connected during %s phase after %u ms",
+                    phase_cfg[phase].name, k_uptime_get_32() - phase_since);
+        }
+        /* The controller already stopped connectable advertising */
+        is_advertising = false;
+        enter_phase(ADV_PHASE_OFF);
+    }
+    if (atomic_get(&n_conn) >= CONFIG_BT_MAX_CONN)
+    {
+        atomic_clear_bit(reqs, REQ_WAKE); /* no slot left to connect to */
+        return;
+    }
+    if (joined > 0 && !atomic_test_bit(reqs, REQ_WAKE))
+    {
+        /* Stay findable for the next phone, without another fast burst */
+        enter_phase(ADV_PHASE_SLOW);
+    }
+
+    const bool expired = phase_cfg[phase].duration_ms &&
+                         (int32_t)(k_uptime_get_32() - phase_deadline) >= 0;
+
+    if (atomic_test_and_clear_bit(reqs, REQ_WAKE))
+    {
+        enter_phase(ADV_PHASE_FAST);
+    }
+    else if (expired && phase == ADV_PHASE_FAST)
+    {
+        enter_phase(ADV_PHASE_SLOW);
+    }
+    else if (expired && phase == ADV_PHASE_SLOW)
+    {
+        enter_phase(ADV_PHASE_BEACON);
+    }
+
+    /* Re-arm for the phase timeout (or the retry of a failed start). Does
+     * nothing if a request already kicked the work again.
+     */
+    if (atomic_test_bit(reqs, REQ_WAKE))
+    {
+        k_work_schedule(&phase_work, K_MSEC(ADV_RETRY_MS));
+    }
+    else if (phase_cfg[phase].duration_ms)
+    {
+        int32_t left = (int32_t)(phase_deadline - k_uptime_get_32());
+        k_work_schedule(&phase_work, K_MSEC(MAX(left, 0)));
+    }
+}
+
+static void post(int req)
+{
+    atomic_set_bit(reqs, req);
+    k_work_reschedule(&phase_work, K_NO_WAIT);
+}
+
+static void status_work_handler(struct k_work *work)
+{
+    if (!bt_is_ready())
+        return; /* adv_start() refreshes the data */
+
+    struct cycle_state_t st;
+    cycle_get_state(&st);
+
+    uint8_t v[ADV_MFG_LEN];
+    memcpy(v, mfg, 3); /* company + version */
+    v[3] = vbat_last_percent();
+    v[4] = st.phase;
+    sys_put_le32(stats_head_seq(), &v[5]);
+    v[9] = schedule_queue_armed() ? ADV_FLAG_SCHEDULE_ARMED : 0;
+
+    if (memcmp(v, mfg, sizeof(mfg)) == 0)
+        return;
+    memcpy(mfg, v, sizeof(mfg));
+
+    /* When not advertising the next start picks the new bytes up */
+    if (!is_advertising)
+        return;
+
+    int err = bt_le_adv_update_data(ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+    if (err)
+    {
+        LOG_WRN("bt_le_adv_update_data err %d", err);
+    }
+}
+
+void adv_status_changed(void)
+{
+    k_work_submit(&status_work);
+}
+
+void adv_start(void)
+{
+    adv_status_changed(); /* queued ahead of the first phase */
+    adv_wake();
+}
+
+void adv_wake(void)
+{
+    post(REQ_WAKE);
+}
+
+bool adv_is_active(void)
+{
+    return is_advertising;
+}
+
+void adv_on_connected(void)
+{
+    is_advertising = false;
+    atomic_inc(&n_conn);
+    atomic_inc(&new_conns);
+    k_work_reschedule(&phase_work, K_NO_WAIT);
+}
+
+void adv_on_disconnected(void)
+{
+    atomic_dec(&n_conn);
+    k_work_reschedule(&phase_work, K_NO_WAIT);
+}
+
+enum adv_phase adv_get_phase(void)
+{
+    return phase;
+}
+
+void adv_get_stats(enum adv_phase p, struct adv_phase_stats *out)
+{
+    if (p >= ADV_PHASE_COUNT || !out)
+        return;
+    *out = phase_stats[p];
+    if (p == phase && p != ADV_PHASE_OFF)
+    {
+        out->ms += k_uptime_get_32() - phase_since;
+    }
+}
@@ -16,6 +16,53 @@ static const struct i2c_dt_spec at24c32_i2c = I2C_DT_SPEC_GET(AT24C32_NODE);
 BUILD_ASSERT(DT_NODE_HAS_STATUS(AT24C32_NODE, okay),
              "AT24C32 node not okay in devicetree");
 
+/* at24c32_lock guards cache/mirror state between the BT RX thread, the
+ * system workqueue and the storage thread; k_mutex is recursive, so public
+ * helpers may call each other while holding it. bus_lock only covers I2C
+ * traffic, so a page being programmed by the storage thread does not stall
+ * readers served from RAM. Lock order is always at24c32_lock -> bus_lock.
+ */
+static K_MUTEX_DEFINE(at24c32_lock);
+static K_MUTEX_DEFINE(bus_lock);
+
+/* Low-priority thread that runs queued jobs and the idle flush in order */
+static K_THREAD_STACK_DEFINE(at24c32_wq_stack, AT24C32_WORKQ_STACK_SIZE);
+static struct k_work_q at24c32_wq;
+static bool at24c32_wq_started;
+
+/* One RAM copy of an EEPROM page. Bit n of `dirty` marks byte n as newer
+ * than the chip; only the span first..last dirty byte is programmed.
+ */
+struct page_frame
+{
+    uint16_t page; /* page number, or FRAME_FREE */
+    bool busy;     /* being programmed by at24c32_flush(); not evictable */
+    uint32_t dirty;
+    uint32_t stamp; /* last use, for LRU eviction */
+    uint8_t data[AT24C32_PAGE_SIZE];
+};
+
+#define FRAME_FREE 0xFFFFu
+
+BUILD_ASSERT(AT24C32_PAGE_SIZE == 32u, "dirty mask assumes 32-byte pages");
+
+static struct page_frame frames[AT24C32_CACHE_FRAMES] = {
+    [0 ... AT24C32_CACHE_FRAMES - 1] = {.page = FRAME_FREE},
+};
+static uint32_t frame_clock;
+
+#if AT24C32_MIRROR
+/* Full RAM image of the device; valid once at24c32_init() has loaded it. */
+static uint8_t mirror[AT24C32_SIZE];
+static bool mirror_valid;
+
+BUILD_ASSERT((AT24C32_SIZE % AT24C32_MIRROR_CHUNK) == 0,
+             "mirror chunk must divide the device size");
+#endif
+
+static void flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+
 /* Internal helpers */
 
 static int at24c32_write_addr(uint16_t addr, const uint8_t *data, size_t len)
@@ -46,7 +93,10 @@ static int at24c32_read_addr(uint16_t addr, uint8_t *data, size_t len)
     addr_buf[0] = (uint8_t)((addr >> 8) & 0xFF);
     addr_buf[1] = (uint8_t)(addr & 0xFF);
 
-    return i2c_write_read_dt(&at24c32_i2c, addr_buf, 2, data, len);
+    k_mutex_lock(&bus_lock, K_FOREVER);
+    int ret = i2c_write_read_dt(&at24c32_i2c, addr_buf, 2, data, len);
+    k_mutex_unlock(&bus_lock);
+    return ret;
 }
 
 /* Poll device for end-of-write ACK (acknowledge polling)
@@ -74,10 +124,255 @@ static int at24c32_wait_ready(void)
     return -ETIMEDOUT;
 }
 
+/* Program bytes within one page and wait out the write cycle. */
+static int bus_program(uint16_t addr, const uint8_t *data, size_t len)
+{
+    k_mutex_lock(&bus_lock, K_FOREVER);
+    int ret = at24c32_write_addr(addr, data, len);
+    if (ret == 0)
+    {
+        ret = at24c32_wait_ready();
+    }
+    k_mutex_unlock(&bus_lock);
+    return ret;
+}
+
+/* ---- Write-back page cache ---- */
+
+static struct page_frame *frame_find(uint16_t page)
+{
+    for (size_t i = 0; i < AT24C32_CACHE_FRAMES; i++)
+    {
+        if (frames[i].page == page)
+        {
+            frames[i].stamp = ++frame_clock;
+            return &frames[i];
+        }
+    }
+    return NULL;
+}
+
+/* Program the dirty span of a frame with a single page write. */
+static int frame_flush(struct page_frame *f)
+{
+    if (f->page == FRAME_FREE || f->dirty == 0)
+    {
+        return 0;
+    }
+
+    const uint8_t first = (uint8_t)__builtin_ctz(f->dirty);
+    const uint8_t last = (uint8_t)(31 - __builtin_clz(f->dirty));
+    const uint16_t addr = (uint16_t)(f->page * AT24C32_PAGE_SIZE + first);
+    const size_t len = (size_t)(last - first + 1u);
+
+    int ret = bus_program(addr, &f->data[first], len);
+    if (ret)
+    {
+        LOG_ERR("Cache flush failed at 0x%04X (%d)", addr, ret);
+        return ret;
+    }
+
+    f->dirty = 0;
+    return 0;
+}
+
+/* Get the frame for `page`, evicting the least recently used one (and
+ * programming it if dirty) when the page is not cached yet.
+ */
+static int frame_get(uint16_t page, struct page_frame **out)
+{
+    struct page_frame *f = frame_find(page);
+    if (f)
+    {
+        *out = f;
+        return 0;
+    }
+
+    for (size_t i = 0; i < AT24C32_CACHE_FRAMES; i++)
+    {
+        if (frames[i].busy)
+        {
+            continue;
+        }
+        if (frames[i].page == FRAME_FREE)
+        {
+            f = &frames[i];
+            break;
+        }
+        if (!f || frames[i].stamp < f->stamp)
+        {
+            f = &frames[i];
+        }
+    }
+    if (!f)
+    {
+        return -EBUSY;
+    }
+
+    int ret = frame_flush(f);
+    if (ret)
+    {
+        return ret;
+    }
+
+    f->page = FRAME_FREE;
+#if AT24C32_MIRROR
+    if (mirror_valid)
+    {
+        memcpy(f->data, &mirror[page * AT24C32_PAGE_SIZE], AT24C32_PAGE_SIZE);
+    }
+    else
+#endif
+    {
+        ret = at24c32_read_addr((uint16_t)(page * AT24C32_PAGE_SIZE), f->data, AT24C32_PAGE_SIZE);
+        if (ret)
+        {
+            LOG_ERR("Cache fill failed for page %u (%d)", page, ret);
+            return ret;
+        }
+    }
+
+    f->page = page;
+    f->dirty = 0;
+    f->stamp = ++frame_clock;
+    *out = f;
+    return 0;
+}
+
+/* Stage a write that lies within one page; unchanged bytes stay clean. */
+static int cache_write(uint16_t addr, const uint8_t *data, size_t len)
+{
+    struct page_frame *f;
+    int ret = frame_get((uint16_t)(addr / AT24C32_PAGE_SIZE), &f);
+    if (ret)
+    {
+        return ret;
+    }
+
+#if AT24C32_MIRROR
+    if (mirror_valid)
+    {
+        memcpy(&mirror[addr], data, len);
+    }
+#endif
+
+    const size_t off = addr % AT24C32_PAGE_SIZE;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (f->data[off + i] != data[i])
+        {
+            f->data[off + i] = data[i];
+            f->dirty |= BIT(off + i);
+        }
+    }
+
+    if (f->dirty && at24c32_wq_started)
+    {
+        k_work_reschedule_for_queue(&at24c32_wq, &flush_work, K_MSEC(AT24C32_CACHE_IDLE_MS));
+    }
+    return 0;
+}
+
+/* Read through the cache: straight from the mirror when it is loaded,
+ * otherwise one burst from the chip overlaid with the cached pages.
+ */
+static int cache_read(uint16_t addr, uint8_t *data, size_t len)
+{
+#if AT24C32_MIRROR
+    if (mirror_valid)
+    {
+        memcpy(data, &mirror[addr], len);
+        return 0;
+    }
+#endif
+
+    const uint16_t first_pg = (uint16_t)(addr / AT24C32_PAGE_SIZE);
+    const uint16_t last_pg = (uint16_t)((addr + len - 1) / AT24C32_PAGE_SIZE);
+    bool all_cached = true;
+
+    for (uint16_t pg = first_pg; pg <= last_pg; pg++)
+    {
+        if (!frame_find(pg))
+        {
+            all_cached = false;
+            break;
+        }
+    }
+
+    if (!all_cached)
+    {
+        int ret = at24c32_read_addr(addr, data, len);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+
+    for (size_t i = 0; i < AT24C32_CACHE_FRAMES; i++)
+    {
+        const struct page_frame *f = &frames[i];
+        if (f->page == FRAME_FREE || f->page < first_pg || f->page > last_pg)
+        {
+            continue;
+        }
+
+        const uint32_t pg_start = (uint32_t)f->page * AT24C32_PAGE_SIZE;
+        const uint32_t lo = MAX(pg_start, (uint32_t)addr);
+        const uint32_t hi = MIN(pg_start + AT24C32_PAGE_SIZE, (uint32_t)addr + len);
+        memcpy(&data[lo - addr], &f->data[lo - pg_start], hi - lo);
+    }
+
+    return 0;
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+    (void)at24c32_flush();
+}
+
+static void job_work_handler(struct k_work *work)
+{
+    struct at24c32_job *job = CONTAINER_OF(work, struct at24c32_job, work);
+    int ret;
+
+    switch (job->op)
+    {
+    case AT24C32_OP_READ:
+        ret = at24c32_read_bytes(job->addr, job->buf, job->len);
+        break;
+    case AT24C32_OP_WRITE:
+        ret = at24c32_write_bytes(job->addr, job->buf, job->len);
+        break;
+    case AT24C32_OP_FLUSH:
+        ret = at24c32_flush();
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    if (job->cb)
+    {
+        job->cb(job, ret);
+    }
+}
+
 /* Public API (names unchanged) */
 
 int at24c32_init(void)
 {
+    if (!at24c32_wq_started)
+    {
+        const struct k_work_queue_config cfg = {.name = "at24c32"};
+
+        k_work_queue_init(&at24c32_wq);
+        k_work_queue_start(&at24c32_wq, at24c32_wq_stack,
+                           K_THREAD_STACK_SIZEOF(at24c32_wq_stack),
+                           AT24C32_WORKQ_PRIORITY, &cfg);
+        at24c32_wq_started = true;
+    }
+
     if (!device_is_ready(at24c32_i2c.bus))
     {
         LOG_ERR("I2C bus for AT24C32 not ready");
@@ -93,12 +388,116 @@ int at24c32_init(void)
     }
 
     LOG_INF("AT24C32 EEPROM found at 0x%02X", at24c32_i2c.addr);
+
+#if AT24C32_MIRROR
+    k_mutex_lock(&at24c32_lock, K_FOREVER);
+    ret = 0;
+    for (uint32_t a = 0; a < AT24C32_SIZE && ret == 0; a += AT24C32_MIRROR_CHUNK)
+    {
+        ret = at24c32_read_addr((uint16_t)a, &mirror[a], AT24C32_MIRROR_CHUNK);
+    }
+
+    if (ret == 0)
+    {
+        /* Anything staged before init is newer than what was just read. */
+        for (size_t i = 0; i < AT24C32_CACHE_FRAMES; i++)
+        {
+            if (frames[i].page != FRAME_FREE)
+            {
+                memcpy(&mirror[frames[i].page * AT24C32_PAGE_SIZE], frames[i].data,
+                       AT24C32_PAGE_SIZE);
+            }
+        }
+        mirror_valid = true;
+        LOG_INF("AT24C32 mirrored into RAM (%u bytes)", AT24C32_SIZE);
+    }
+    else
+    {
+        LOG_WRN("AT24C32 mirror load failed (%d); reading from the bus", ret);
+    }
+    k_mutex_unlock(&at24c32_lock);
+#endif
+
     return 0;
 }
 
 int at24c32_is_ready(void)
 {
-    return at24c32_wait_ready();
+    k_mutex_lock(&bus_lock, K_FOREVER);
+    int ret = at24c32_wait_ready();
+    k_mutex_unlock(&bus_lock);
+    return ret;
+}
+
+/* Each dirty span is copied out and the frame marked clean under the cache
+ * lock; the page write and its write cycle then run under the bus lock only,
+ * so other threads keep reading and staging writes meanwhile.
+ */
+int at24c32_flush(void)
+{
+    int ret = 0;
+
+    for (size_t i = 0; i < AT24C32_CACHE_FRAMES; i++)
+    {
+        struct page_frame *f = &frames[i];
+        uint8_t buf[AT24C32_PAGE_SIZE];
+
+        k_mutex_lock(&at24c32_lock, K_FOREVER);
+        if (f->page == FRAME_FREE || f->dirty == 0 || f->busy)
+        {
+            k_mutex_unlock(&at24c32_lock);
+            continue;
+        }
+
+        const uint32_t mask = f->dirty;
+        const uint8_t first = (uint8_t)__builtin_ctz(mask);
+        const uint8_t last = (uint8_t)(31 - __builtin_clz(mask));
+        const uint16_t addr = (uint16_t)(f->page * AT24C32_PAGE_SIZE + first);
+        const size_t len = (size_t)(last - first + 1u);
+
+        memcpy(buf, &f->data[first], len);
+        f->dirty = 0;
+        f->busy = true;
+        k_mutex_unlock(&at24c32_lock);
+
+        int rc = bus_program(addr, buf, len);
+
+        k_mutex_lock(&at24c32_lock, K_FOREVER);
+        f->busy = false;
+        if (rc)
+        {
+            LOG_ERR("Cache flush failed at 0x%04X (%d)", addr, rc);
+            f->dirty |= mask; /* retry on the next flush */
+            if (ret == 0)
+            {
+                ret = rc;
+            }
+        }
+        k_mutex_unlock(&at24c32_lock);
+    }
+
+    return ret;
+}
+
+int at24c32_submit(struct at24c32_job *job)
+{
+    if (!job || !at24c32_wq_started)
+    {
+        return -EINVAL;
+    }
+    if (job->op != AT24C32_OP_FLUSH && (!job->buf || job->len == 0))
+    {
+        return -EINVAL;
+    }
+
+    k_work_init(&job->work, job_work_handler);
+    int ret = k_work_submit_to_queue(&at24c32_wq, &job->work);
+    return (ret < 0) ? ret : 0;
+}
+
+struct k_work_q *at24c32_workq(void)
+{
+    return &at24c32_wq;
 }
 
 int at24c32_write_byte(uint16_t addr, uint8_t data)
@@ -108,14 +507,15 @@ int at24c32_write_byte(uint16_t addr, uint8_t data)
         return -EINVAL;
     }
 
-    int ret = at24c32_write_addr(addr, &data, 1);
+    k_mutex_lock(&at24c32_lock, K_FOREVER);
+    int ret = cache_write(addr, &data, 1);
+    k_mutex_unlock(&at24c32_lock);
     if (ret)
     {
         LOG_ERR("Write byte failed at 0x%04X (%d)", addr, ret);
-        return ret;
     }
 
-    return at24c32_wait_ready();
+    return ret;
 }
 
 int at24c32_read_byte(uint16_t addr, uint8_t *data)
@@ -125,7 +525,9 @@ int at24c32_read_byte(uint16_t addr, uint8_t *data)
         return -EINVAL;
     }
 
-    int ret = at24c32_read_addr(addr, data, 1);
+    k_mutex_lock(&at24c32_lock, K_FOREVER);
+    int ret = cache_read(addr, data, 1);
+    k_mutex_unlock(&at24c32_lock);
     if (ret)
     {
         LOG_ERR("Read byte failed at 0x%04X (%d)", addr, ret);
@@ -154,14 +556,15 @@ int at24c32_write_page(uint16_t addr, const uint8_t *data, size_t len)
         return -EINVAL;
     }
 
-    int ret = at24c32_write_addr(addr, data, len);
+    k_mutex_lock(&at24c32_lock, K_FOREVER);
+    int ret = cache_write(addr, data, len);
+    k_mutex_unlock(&at24c32_lock);
     if (ret)
     {
         LOG_ERR("Page write failed at 0x%04X (%d)", addr, ret);
-        return ret;
     }
 
-    return at24c32_wait_ready();
+    return ret;
 }
 
 int at24c32_read_bytes(uint16_t addr, uint8_t *data, size_t len)
@@ -175,7 +578,9 @@ int at24c32_read_bytes(uint16_t addr, uint8_t *data, size_t len)
         return -EINVAL;
     }
 
-    int ret = at24c32_read_addr(addr, data, len);
+    k_mutex_lock(&at24c32_lock, K_FOREVER);
+    int ret = cache_read(addr, data, len);
+    k_mutex_unlock(&at24c32_lock);
     if (ret)
     {
         LOG_ERR("Read bytes failed at 0x%04X (%d)", addr, ret);
@@ -314,25 +719,27 @@ int at24c32_update_bits(uint16_t addr, uint8_t mask, uint8_t value)
         return -EINVAL;
     }
 
+    k_mutex_lock(&at24c32_lock, K_FOREVER);
+
     uint8_t b = 0;
     int rc = at24c32_read_byte(addr, &b);
     if (rc)
     {
         LOG_ERR("update_bits: read failed at 0x%04X (%d)", addr, rc);
+        k_mutex_unlock(&at24c32_lock);
         return rc;
     }
 
     uint8_t nb = (uint8_t)((b & ~mask) | (value & mask));
-    if (nb == b)
-    {
-        return 0; /* no change; save a write cycle */
-    }
-
-    rc = at24c32_write_byte(addr, nb);
-    if (rc)
+    if (nb != b) /* no change; save a write cycle */
     {
-        LOG_ERR("update_bits: write failed at 0x%04X (%d)", addr, rc);
+        rc = at24c32_write_byte(addr, nb);
+        if (rc)
+        {
+            LOG_ERR("update_bits: write failed at 0x%04X (%d)", addr, rc);
+        }
     }
 
+    k_mutex_unlock(&at24c32_lock);
     return rc;
 }
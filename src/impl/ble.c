@@ -16,31 +16,63 @@
 #include <zephyr/logging/log.h>
 
 #include "stats.h"
+#include "at24c32.h"
+#include "rollups.h"
 #include "tm_helpers.h"
 #include "ble.h"
 #include "spray.h"
 #include "mcp7940n.h"
 #include "schedule_queue.h"
 #include "schedule.h"
+#include "link.h"
+#include "adv.h"
 
 LOG_MODULE_REGISTER(BLE, LOG_LEVEL_INF);
 
-static uint16_t stats_start = 0;
-static uint8_t stats_window = 63;
-
+/* Statistics read payload:
+ *   [count u16 LE][want u8][start_seq u32 LE][head_seq u32 LE]
+ *   then `want` entries of [time7][intensity] for seq start_seq.. in order.
+ * count is the number of stored events; head_seq is the total ever logged,
+ * so events below head_seq - count were lost to wrap-around or a clear.
+ */
 enum
 {
-    ST_HDR = 2,
+    ST_HDR = 11,
     ST_ENTRY = 8,
     ST_MAX_RETURNED = 63
 };
 
+/* Delta sync payload, after a control write of [since_seq u32 LE]:
+ *   [start_seq u32 LE][head_seq u32 LE][n u8]
+ *   then, if n > 0, [epoch u32 LE] of the first event (seconds since
+ *   2000-01-01) and n tm_varints of (zigzag(delta_s) << 2 | intensity),
+ *   each delta from the previous event (0 for the first).
+ * The events are seq [start_seq, start_seq + n). start_seq > since_seq means
+ * older ones were overwritten; start_seq + n < head_seq means more are left,
+ * so sync again from there. Passing the previous head_seq as since_seq
+ * fetches only what is new.
+ */
 enum
 {
-    SCH_HDR = 1,
+    SY_HDR = 9,
+    SY_EPOCH = 4,
+    SY_BATCH = 16 /* entries decoded per range read */
+};
+
+/* Schedule payload: the stored image, [count u8][format u8][days x8] then
+ * count u16 items (see schedule.h). Writes also take the two older forms,
+ * [count u8] then count 4-byte rules or count [time7][intensity] entries
+ * (daily); those are odd in length and the image is even.
+ */
+enum
+{
+    SCH_HDR = 1, /* older forms */
+    SCH_RULE = 4,
     SCH_ENTRY = 8
 };
 
+BUILD_ASSERT(sizeof(struct stats_entry) == ST_ENTRY, "entries go on the air as decoded");
+
 static int parse_gadi_time_payload(const uint8_t *buf, uint16_t len, struct tm *out)
 {
     if (len != 7)
@@ -65,180 +97,420 @@ static int parse_gadi_time_payload(const uint8_t *buf, uint16_t len, struct tm *
 //     // Eat 5 - Star - Do Nothing
 // }
 
-static ssize_t schedule_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-                             void *buf, uint16_t len, uint16_t offset)
+/* Long reads: the payload is never materialised. At offset 0 a read
+ * freezes what it describes in a per-connection cursor (count, start/head
+ * sequence numbers), and every read, first or continuation, re-encodes
+ * just the requested byte window straight into the ATT buffer. Stored
+ * events are immutable by sequence number, so slices stay consistent; if
+ * the source moved under a cursor (schedule rewritten, events overwritten)
+ * it is frozen again. Stack use is one record or one range batch.
+ */
+#define READ_MAX (ST_HDR + ST_MAX_RETURNED * ST_ENTRY) /* cap for the sync payload */
+
+BUILD_ASSERT(SCH_RULE == SCHED_RULE_LEN && SCH_ENTRY == SCHED_ENTRY_LEN,
+             "older schedule forms are read in wire layout");
+BUILD_ASSERT((SCHED_HDR_LEN & 1u) == 0 && (SCHED_ITEM_LEN & 1u) == 0,
+             "schedule images must stay even in length");
+
+struct read_cursor
 {
+    const struct bt_gatt_attr *attr; /* owner, NULL = none */
+    uint32_t gen;                    /* schedule: sched_generation() */
+    uint32_t start;                  /* stats: first sequence number */
+    uint32_t head;
+    uint16_t total;
+    uint8_t n; /* records in the payload */
+};
 
-    LOG_INF("schedule_read: handle=0x%04x offset=%u len=%u",
-            attr ? attr->handle : 0, offset, len);
+/* Per-connection state, one slot per entry of the host's connection pool
+ * (bt_conn_index()), reset on connect.
+ */
+struct conn_ctx
+{
+    /* Statistics window, addressed by event sequence number (see stats.h) */
+    uint32_t stats_start_seq;
+    uint8_t stats_window;
+    bool stats_sync; /* delta sync payload instead of the window */
 
-    schedule_queue_log();
-    const uint8_t total = sched_count();
-    const uint32_t full_len = (uint32_t)SCH_HDR + (uint32_t)total * SCH_ENTRY;
+    struct read_cursor cur;
 
-    if (offset > full_len)
-    {
-        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
-    }
-    if (offset == full_len)
+    uint8_t write_status[2]; /* last commit result for this connection's writes */
+};
+
+static struct conn_ctx conn_ctx[CONFIG_BT_MAX_CONN];
+
+static inline struct conn_ctx *ctx_of(struct bt_conn *conn)
+{
+    return &conn_ctx[bt_conn_index(conn)];
+}
+
+static void cursor_drop(struct bt_conn *conn)
+{
+    ctx_of(conn)->cur.attr = NULL;
+}
+
+/* Window encoder: the payload is produced front to back, but only bytes in
+ * [off, off + len) are stored, at dst. pos counts every payload byte.
+ */
+struct enc
+{
+    uint8_t *dst;
+    uint32_t off;
+    uint32_t len;
+    uint32_t pos;
+    uint16_t done; /* bytes stored in dst */
+};
+
+#define ENC_INIT(d, l, o) {.dst = (uint8_t *)(d), .off = (o), .len = (l)}
+#define ENC_COUNT {.off = UINT16_MAX} /* measures only: the window is never reached */
+
+static inline bool enc_full(const struct enc *e)
+{
+    return e->pos >= e->off + e->len;
+}
+
+/* Returns false once the window is full */
+static bool enc_put(struct enc *e, const void *src, uint32_t n)
+{
+    const uint32_t end = e->pos + n;
+    if (end > e->off && !enc_full(e))
     {
-        return 0; // nothing left
+        const uint32_t from = MAX(e->pos, e->off);
+        const uint32_t to = MIN(end, e->off + e->len);
+        memcpy(&e->dst[from - e->off], (const uint8_t *)src + (from - e->pos), to - from);
+        e->done = (uint16_t)(e->done + (to - from));
     }
+    e->pos = end;
+    return !enc_full(e);
+}
+
+static ssize_t enc_result(const struct enc *e)
+{
+    if (e->off > e->pos)
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    return e->done;
+}
+
+static void schedule_freeze(struct read_cursor *rc)
+{
+    schedule_queue_log();
+    rc->gen = sched_generation();
+    rc->n = sched_count();
+    LOG_INF("Schedule Read: count=%u", rc->n);
+}
 
-    uint16_t to_copy = len;
-    if ((uint32_t)offset + to_copy > full_len)
+static void schedule_encode(const struct read_cursor *rc, struct enc *e)
+{
+    uint8_t hdr[SCHED_HDR_LEN] = {rc->n, SCHED_FORMAT};
+    for (uint8_t s = 0; s < SCHED_DAYSETS; ++s)
     {
-        to_copy = (uint16_t)(full_len - offset);
+        hdr[2 + s] = sched_days(s);
     }
+    if (!enc_put(e, hdr, sizeof(hdr)))
+        return;
 
-    uint8_t out[to_copy];
-    uint16_t produced = 0;
-    uint32_t cur = offset;
+    const uint8_t i0 = (e->off > SCHED_HDR_LEN) ? (uint8_t)((e->off - SCHED_HDR_LEN) / SCHED_ITEM_LEN) : 0;
+    e->pos += (uint32_t)i0 * SCHED_ITEM_LEN;
 
-    // Header slice
-    if (cur < SCH_HDR)
+    for (uint8_t i = i0; i < rc->n; i++)
     {
-        const uint8_t hdr[SCH_HDR] = {total};
-        const uint16_t hdr_rem = (uint16_t)(SCH_HDR - cur);
-        const uint16_t chunk = (hdr_rem < to_copy) ? hdr_rem : to_copy;
-        memcpy(out, &hdr[cur], chunk);
-        produced += chunk;
-        cur += chunk;
+        uint16_t it = 0;
+        if (sched_get(i, &it) < 0)
+        {
+            LOG_WRN("sched_get(%u) failed while building read", i);
+        }
 
-        LOG_INF("Schedule Read: count=%u", total);
+        if (e->off == 0)
+        {
+            LOG_INF("Schedule[%u]: %02u:%02u days=0x%02x intensity=%u", i,
+                    SCHED_ITEM_MIN(it) / 60u, SCHED_ITEM_MIN(it) % 60u,
+                    sched_days(SCHED_ITEM_SET(it)), SCHED_ITEM_INT(it));
+        }
+
+        uint8_t le[SCHED_ITEM_LEN];
+        sys_put_le16(it, le);
+        if (!enc_put(e, le, sizeof(le)))
+            return;
     }
+}
 
-    // Entry slices
-    while (produced < to_copy)
-    {
-        const uint32_t entries_off = cur - SCH_HDR;
-        const uint16_t rel_idx = (uint16_t)(entries_off / SCH_ENTRY);
-        const uint8_t entry_off = (uint8_t)(entries_off % SCH_ENTRY);
-        const uint16_t abs_idx = rel_idx;
+static ssize_t schedule_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                             void *buf, uint16_t len, uint16_t offset)
+{
 
-        uint8_t time7[7], inten2b = 0;
-        if (sched_get((uint8_t)abs_idx, time7, &inten2b) < 0)
+    LOG_INF("schedule_read: handle=0x%04x offset=%u len=%u",
+            attr ? attr->handle : 0, offset, len);
+
+    struct read_cursor *rc = &ctx_of(conn)->cur;
+    link_bulk(conn);
+    if (offset == 0 || rc->attr != attr || rc->gen != sched_generation())
+    {
+        if (offset != 0)
         {
-            LOG_WRN("sched_get(%u) failed while building read", abs_idx);
-            break;
+            LOG_WRN("schedule changed mid-read (offset=%u)", offset);
         }
+        schedule_freeze(rc);
+        rc->attr = attr;
+    }
 
-        uint8_t entry_buf[SCH_ENTRY];
-        memcpy(entry_buf, time7, 7);
-        entry_buf[7] = (uint8_t)(inten2b & 0x03);
+    struct enc e = ENC_INIT(buf, len, offset);
+    schedule_encode(rc, &e);
+    return enc_result(&e);
+}
 
-        const uint16_t entry_rem = (uint16_t)(SCH_ENTRY - entry_off);
-        const uint16_t space_rem = (uint16_t)(to_copy - produced);
-        const uint16_t chunk = (entry_rem < space_rem) ? entry_rem : space_rem;
+/* Sync records for seq [start, head): the first event's epoch, then one
+ * varint per event, at most max_n events and READ_MAX payload bytes in
+ * total. Returns the number of events emitted (or measured).
+ */
+static uint8_t sync_records(uint32_t start, uint32_t head, uint8_t max_n, struct enc *e)
+{
+    uint32_t seq = start;
+    uint32_t prev = 0;
+    uint8_t n = 0;
 
-        memcpy(out + produced, entry_buf + entry_off, chunk);
-        produced += chunk;
-        cur += chunk;
+    while (seq != head && n < max_n)
+    {
+        struct stats_entry batch[SY_BATCH];
+        const uint8_t got = stats_get_range(seq, (uint8_t)MIN((uint32_t)SY_BATCH, (uint32_t)(max_n - n)), batch);
+        if (got == 0)
+        {
+            LOG_WRN("stats_get_range(%u) failed; sync cut short", seq);
+            break;
+        }
 
-        if (entry_off == 0)
+        for (uint8_t i = 0; i < got; i++)
         {
-            struct tm tmv = {0};
-            tm_from_7(&tmv, time7);
-            char tsbuf[64];
-            (void)tm_to_str(&tmv, tsbuf, sizeof(tsbuf));
-            LOG_INF("Schedule[%u]: %s  intensity=%u",
-                    abs_idx, tsbuf, (unsigned)(inten2b & 0x03));
+            const uint32_t when = tm7_to_epoch(batch[i].time);
+            uint8_t first[SY_EPOCH];
+            if (n == 0)
+            {
+                sys_put_le32(when, first);
+                prev = when;
+            }
+
+            const int32_t d = (int32_t)(when - prev);
+            const uint32_t zz = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+            uint8_t v[TM_VARINT_MAX];
+            const size_t vlen = (zz < (TM_VARINT_LIMIT >> 2))
+                                    ? tm_varint_put((zz << 2) | (batch[i].int2b & 0x03u), v)
+                                    : 0;
+            if (vlen == 0 || e->pos + (n == 0 ? SY_EPOCH : 0) + vlen > READ_MAX)
+            {
+                return n; /* client resumes from start_seq + n */
+            }
+            if (n == 0)
+            {
+                (void)enc_put(e, first, SY_EPOCH);
+            }
+            const bool more = enc_put(e, v, (uint32_t)vlen);
+            prev = when;
+            n++;
+            if (!more)
+            {
+                return n; /* window full; the rest is not needed */
+            }
         }
+        seq += got;
     }
+    return n;
+}
 
-    LOG_HEXDUMP_INF(out, produced, "Schedule Read Slice");
-    return bt_gatt_attr_read(conn, attr, buf, len, offset, out, produced);
+static void sync_freeze(const struct conn_ctx *cc, struct read_cursor *rc)
+{
+    uint32_t first, head;
+    stats_bounds(&first, &head);
+    uint32_t start = cc->stats_start_seq;
+    if (start - first > head - first)
+        start = (start > head) ? head : first;
+
+    struct enc count = ENC_COUNT;
+    count.pos = SY_HDR;
+    rc->start = start;
+    rc->head = head;
+    rc->n = sync_records(start, head, UINT8_MAX, &count);
+    rc->total = (uint16_t)count.pos;
+
+    LOG_INF("Stats Sync: start=%u n=%u head=%u (%u bytes)", start, rc->n, head, rc->total);
 }
 
-static ssize_t statistics_read(struct bt_conn *conn,
-                               const struct bt_gatt_attr *attr,
-                               void *buf, uint16_t len, uint16_t offset)
+static void sync_encode(const struct read_cursor *rc, struct enc *e)
 {
-    const uint8_t total = stats_count();
+    uint8_t hdr[SY_HDR];
+    sys_put_le32(rc->start, &hdr[0]);
+    sys_put_le32(rc->head, &hdr[4]);
+    hdr[8] = rc->n;
+    if (enc_put(e, hdr, SY_HDR) && rc->n)
+    {
+        (void)sync_records(rc->start, rc->head, rc->n, e);
+    }
+}
 
-    uint16_t start = stats_start;
-    uint8_t want = stats_window;
-    if (start > total)
-        start = total;
-    uint16_t avail = (uint16_t)(total - start);
+static void window_freeze(const struct conn_ctx *cc, struct read_cursor *rc)
+{
+    uint32_t first, head;
+    stats_bounds(&first, &head);
+
+    // Records below the tail were overwritten; start from what is left.
+    uint32_t start = cc->stats_start_seq;
+    if (start < first)
+        start = first;
+    if (start > head)
+        start = head;
+    uint32_t avail = head - start;
+    uint8_t want = cc->stats_window;
     if (want > ST_MAX_RETURNED)
         want = ST_MAX_RETURNED;
     if (want > avail)
         want = (uint8_t)avail;
 
-    const uint32_t full_len = (uint32_t)ST_HDR + (uint32_t)want * ST_ENTRY;
+    rc->total = (uint16_t)(head - first);
+    rc->start = start;
+    rc->head = head;
+    rc->n = want;
 
-    if (offset > full_len)
-        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
-    if (offset == full_len)
-        return 0;
+    LOG_INF("Stats Read Header: total=%u want=%u (start=%u head=%u)",
+            rc->total, want, start, head);
+}
 
-    uint16_t to_copy = len;
-    if ((uint32_t)offset + to_copy > full_len)
+/* Whole entries inside the window are read straight into it (decoded
+ * entries already have the wire layout); the two edge entries go through
+ * one stack record.
+ */
+static void window_encode(const struct read_cursor *rc, struct enc *e)
+{
+    uint8_t hdr[ST_HDR];
+    sys_put_le16(rc->total, &hdr[0]);
+    hdr[2] = rc->n;
+    sys_put_le32(rc->start, &hdr[3]);
+    sys_put_le32(rc->head, &hdr[7]);
+    if (!enc_put(e, hdr, ST_HDR))
+        return;
+
+    uint8_t i = (e->off > ST_HDR) ? (uint8_t)MIN((e->off - ST_HDR) / ST_ENTRY, rc->n) : 0;
+    e->pos += (uint32_t)i * ST_ENTRY;
+
+    while (i < rc->n && !enc_full(e))
     {
-        to_copy = (uint16_t)(full_len - offset);
-    }
+        const uint32_t seq = rc->start + i;
+        const uint32_t room = e->off + e->len - e->pos;
 
-    uint8_t out[to_copy];
-    uint16_t produced = 0;
-    uint32_t cur = offset;
-
-    if (cur < ST_HDR)
+        if (e->pos >= e->off && room >= ST_ENTRY)
+        {
+            const uint8_t k = (uint8_t)MIN((uint32_t)(rc->n - i), room / ST_ENTRY);
+            const uint8_t got = stats_get_range(seq, k, (struct stats_entry *)&e->dst[e->pos - e->off]);
+            if (got == 0)
+                break;
+            e->pos += (uint32_t)got * ST_ENTRY;
+            e->done = (uint16_t)(e->done + got * ST_ENTRY);
+            i += got;
+        }
+        else
+        {
+            struct stats_entry one;
+            if (stats_get_range(seq, 1, &one) != 1)
+                break;
+            (void)enc_put(e, &one, ST_ENTRY);
+            i++;
+        }
+    }
+    if (i < rc->n && !enc_full(e))
     {
-        const uint8_t hdr[ST_HDR] = {total, want};
-        const uint16_t hdr_rem = (uint16_t)(ST_HDR - cur);
-        const uint16_t chunk = (hdr_rem < to_copy) ? hdr_rem : to_copy;
-        memcpy(out, &hdr[cur], chunk);
-        produced += chunk;
-        cur += chunk;
-
-        LOG_INF("Stats Read Header: total=%u want=%u (start=%u)", total, want, start);
+        LOG_WRN("stats_get_range(%u) failed mid-read", rc->start + i);
     }
+}
 
-    while (produced < to_copy)
+static ssize_t statistics_read(struct bt_conn *conn,
+                               const struct bt_gatt_attr *attr,
+                               void *buf, uint16_t len, uint16_t offset)
+{
+    struct conn_ctx *cc = ctx_of(conn);
+    struct read_cursor *rc = &cc->cur;
+    uint32_t first, head;
+    stats_bounds(&first, &head);
+
+    link_bulk(conn);
+    // Still valid while none of the frozen events has been overwritten
+    if (offset == 0 || rc->attr != attr || rc->start - first > head - first)
     {
-        const uint32_t entries_off = cur - ST_HDR;
-        const uint16_t rel_idx = (uint16_t)(entries_off / ST_ENTRY);
-        const uint8_t entry_off = (uint8_t)(entries_off % ST_ENTRY);
-        const uint16_t abs_idx = (uint16_t)(start + rel_idx);
-
-        uint8_t time7[7], inten2b = 0;
-        if (!stats_get((uint8_t)abs_idx, time7, &inten2b))
+        if (offset != 0)
         {
-            LOG_WRN("stats_get(%u) failed; stopping read build", abs_idx);
-            break;
+            LOG_WRN("stats moved mid-read (offset=%u)", offset);
         }
+        if (cc->stats_sync)
+            sync_freeze(cc, rc);
+        else
+            window_freeze(cc, rc);
+        rc->attr = attr;
+    }
 
-        uint8_t entry_buf[ST_ENTRY];
-        memcpy(entry_buf, time7, 7);
-        entry_buf[7] = (uint8_t)(inten2b & 0x03);
+    struct enc e = ENC_INIT(buf, len, offset);
+    if (cc->stats_sync)
+        sync_encode(rc, &e);
+    else
+        window_encode(rc, &e);
+    return enc_result(&e);
+}
 
-        const uint16_t entry_rem = (uint16_t)(ST_ENTRY - entry_off);
-        const uint16_t space_rem = (uint16_t)(to_copy - produced);
-        const uint16_t chunk = (entry_rem < space_rem) ? entry_rem : space_rem;
+/* Accepted forms:
+ *   [start_seq u32 LE][window u8]  start at an event sequence number
+ *   [start_idx u8][window u8]      legacy: index from the oldest stored
+ *   [since_seq u32 LE]             delta sync from a cursor (see SY_HDR)
+ */
+static int stats_ctrl_apply(struct bt_conn *conn, const uint8_t *p, uint16_t len)
+{
+    if (len != 2 && len != 4 && len != 5)
+        return -EMSGSIZE;
 
-        memcpy(out + produced, entry_buf + entry_off, chunk);
-        produced += chunk;
-        cur += chunk;
+    struct conn_ctx *cc = ctx_of(conn);
+    cursor_drop(conn);
 
-        if (entry_off == 0)
-        {
-            struct tm tmv = {0};
-            tm_from_7(&tmv, time7); // month expected 0..11 per your comment above
-            char tsbuf[64];
-            (void)tm_to_str(&tmv, tsbuf, sizeof(tsbuf));
-
-            LOG_INF("Stats Entry[%u]: ts=%s  raw=%02x %02x %02x %02x %02x %02x %02x  intensity=%u",
-                    abs_idx,
-                    tsbuf,
-                    time7[0], time7[1], time7[2], time7[3], time7[4], time7[5], time7[6],
-                    (unsigned)(inten2b & 0x03));
-        }
+    if (len == 4)
+    {
+        cc->stats_start_seq = sys_get_le32(p);
+        cc->stats_sync = true;
+        LOG_INF("Delta sync: since_seq=%u (first=%u head=%u)",
+                cc->stats_start_seq, stats_first_seq(), stats_head_seq());
+        return 0;
     }
+    cc->stats_sync = false;
+
+    uint32_t first, head;
+    stats_bounds(&first, &head);
+    uint32_t start_req;
+    uint8_t win_req;
+
+    if (len == 5)
+    {
+        start_req = sys_get_le32(p);
+        win_req = p[4];
+    }
+    else
+    {
+        start_req = first + p[0];
+        win_req = p[1];
+    }
+
+    LOG_INF("Parsed control: start_seq=%u window_req=%u", start_req, win_req);
+
+    uint32_t start = start_req;
+    if (start < first)
+        start = first;
+    if (start > head)
+        start = head;
 
-    LOG_HEXDUMP_INF(out, produced, "Stats Read Outgoing Slice:");
+    uint8_t win = (win_req == 0 || win_req > ST_MAX_RETURNED) ? ST_MAX_RETURNED : win_req;
+
+    uint32_t avail = head - start;
+    if (win > avail)
+        win = (uint8_t)avail;
 
-    return bt_gatt_attr_read(conn, attr, buf, len, offset, out, produced);
+    cc->stats_start_seq = start;
+    cc->stats_window = win;
+
+    LOG_INF("Effective window: start_seq=%u window=%u (first=%u head=%u)",
+            start, win, first, head);
+
+    return 0;
 }
 
 static ssize_t statistics_ctrl_write(struct bt_conn *conn,
@@ -251,105 +523,534 @@ static ssize_t statistics_ctrl_write(struct bt_conn *conn,
             attr ? attr->handle : 0, offset, len, flags);
     LOG_HEXDUMP_INF(buf, len, "Stats Ctrl Write (incoming)");
 
-    if (offset != 0 || len != 2)
+    if (offset != 0 || stats_ctrl_apply(conn, buf, len))
     {
-        LOG_WRN("Invalid write: offset=%u len=%u (expect 2)", offset, len);
+        LOG_WRN("Invalid write: offset=%u len=%u (expect 2, 4 or 5)", offset, len);
         return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
     }
 
-    const uint8_t *p = buf;
-    uint8_t start_req = p[0];
-    uint8_t win_req = p[1];
+    return len;
+}
 
-    LOG_INF("Parsed control: start_req=%u window_req=%u", start_req, win_req);
+/* Statistics streaming: the client writes [start_seq u32 LE] to the stream
+ * characteristic (with notifications enabled) and the firmware pushes
+ *   [seq u32 LE][entries: time7 + intensity]...
+ * notifications back-to-back, as many entries as fit the ATT MTU, ending
+ * with one carrying only [head_seq u32 LE]. An empty write cancels.
+ * At most STREAM_CREDITS notifications are in flight; each completion
+ * callback returns a credit and resumes the work item, which runs on the
+ * EEPROM storage thread so it never races stats appends.
+ */
+#define STREAM_PDU_MAX 244u /* 247-byte ATT MTU */
+#define STREAM_SEQ_LEN 4u
+#define STREAM_CREDITS MAX(1, CONFIG_BT_CONN_TX_MAX - 1)
+#define STREAM_RETRY_MS 20
+
+/* Owned by the work item alone, which also takes and drops the ref */
+static struct
+{
+    struct bt_conn *conn; /* ref held while a stream is set up */
+    uint32_t next_seq;
+    bool active;
+} stream;
+
+/* Requests from the ATT and connection callbacks, under stream_lock. conn
+ * is not ref'd: it is the stream's connection from the accepted start
+ * until the work item lets go of it, and disconnect clears it before the
+ * stack can free the object, so the work item may ref it under the lock.
+ */
+static K_MUTEX_DEFINE(stream_lock);
+static struct
+{
+    struct bt_conn *conn;
+    uint32_t seq;
+    bool busy;  /* a stream is pending or running; conn is set */
+    bool start; /* not picked up by the work item yet */
+    bool stop;
+} stream_req;
 
-    const uint8_t total = stats_count();
+static uint8_t stream_pdu[STREAM_PDU_MAX];
 
-    uint16_t start = start_req;
-    if (start > total)
-        start = total;
+static void stream_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(stream_work, stream_work_handler);
+static K_SEM_DEFINE(stream_credits, STREAM_CREDITS, STREAM_CREDITS);
 
-    uint8_t win = (win_req == 0 || win_req > ST_MAX_RETURNED) ? ST_MAX_RETURNED : win_req;
+static void stream_sent_cb(struct bt_conn *conn, void *user_data)
+{
+    k_sem_give(&stream_credits);
+    k_work_reschedule_for_queue(at24c32_workq(), &stream_work, K_NO_WAIT);
+}
 
-    uint16_t avail = total - start;
-    if (win > avail)
-        win = (uint8_t)avail;
+static const struct bt_gatt_attr *stream_attr(void);
 
-    stats_start = (uint16_t)start;
-    stats_window = win;
+static void stream_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&stream_lock, K_FOREVER);
+    if (stream_req.start)
+    {
+        stream.conn = bt_conn_ref(stream_req.conn);
+        stream.next_seq = stream_req.seq;
+        stream.active = true;
+        stream_req.start = false;
+    }
+    if (stream_req.stop)
+    {
+        stream.active = false;
+        stream_req.stop = false;
+    }
+    k_mutex_unlock(&stream_lock);
 
-    LOG_INF("Effective window: start=%u window=%u (total=%u)", start, win, total);
+    while (stream.active)
+    {
+        if (!bt_gatt_is_subscribed(stream.conn, stream_attr(), BT_GATT_CCC_NOTIFY))
+        {
+            LOG_INF("stats stream: unsubscribed, stopping");
+            stream.active = false;
+            break;
+        }
+        if (k_sem_take(&stream_credits, K_NO_WAIT))
+        {
+            return; /* resumed by stream_sent_cb() */
+        }
 
-    return len;
+        link_bulk(stream.conn);
+        const uint16_t mtu = bt_gatt_get_mtu(stream.conn);
+        const uint16_t room = MIN((uint16_t)(mtu - 3u), (uint16_t)STREAM_PDU_MAX);
+        const uint8_t max_n = (uint8_t)((room - STREAM_SEQ_LEN) / ST_ENTRY);
+
+        // Skip whatever was overwritten since the export started
+        uint32_t first, head;
+        stats_bounds(&first, &head);
+        if (stream.next_seq - first > head - first)
+        {
+            stream.next_seq = first;
+        }
+
+        const uint8_t n = stats_get_range(stream.next_seq, max_n,
+                                          (struct stats_entry *)&stream_pdu[STREAM_SEQ_LEN]);
+        sys_put_le32(n ? stream.next_seq : head, stream_pdu);
+
+        struct bt_gatt_notify_params params = {
+            .attr = stream_attr(),
+            .data = stream_pdu,
+            .len = (uint16_t)(STREAM_SEQ_LEN + n * ST_ENTRY),
+            .func = stream_sent_cb,
+        };
+        int err = bt_gatt_notify_cb(stream.conn, &params);
+        if (err)
+        {
+            k_sem_give(&stream_credits);
+            if (err == -ENOMEM)
+            {
+                // Out of buffers (other traffic); a completion or the retry resumes us
+                k_work_schedule_for_queue(at24c32_workq(), &stream_work, K_MSEC(STREAM_RETRY_MS));
+                return;
+            }
+            LOG_WRN("stats stream: notify failed (%d), stopping", err);
+            stream.active = false;
+            break;
+        }
+
+        if (n == 0)
+        {
+            LOG_INF("stats stream: done at seq %u", head);
+            stream.active = false;
+            break;
+        }
+        stream.next_seq += n;
+    }
+
+    if (!stream.active && stream.conn)
+    {
+        k_mutex_lock(&stream_lock, K_FOREVER);
+        stream_req.conn = NULL;
+        stream_req.busy = false;
+        k_mutex_unlock(&stream_lock);
+
+        bt_conn_unref(stream.conn);
+        stream.conn = NULL;
+    }
 }
 
-static ssize_t schedule_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+/* Ask the work item to end the stream on conn, if it has one */
+static bool stream_stop(struct bt_conn *conn)
+{
+    bool hit = false;
+
+    k_mutex_lock(&stream_lock, K_FOREVER);
+    if (stream_req.busy && stream_req.conn == conn)
+    {
+        hit = true;
+        if (stream_req.start)
+        {
+            /* Never picked up, so no ref to drop */
+            stream_req.start = false;
+            stream_req.busy = false;
+            stream_req.conn = NULL;
+        }
+        else
+        {
+            stream_req.stop = true;
+        }
+    }
+    k_mutex_unlock(&stream_lock);
+
+    if (hit)
+    {
+        k_work_reschedule_for_queue(at24c32_workq(), &stream_work, K_NO_WAIT); /* drops the ref */
+    }
+    return hit;
+}
+
+/* value is the aggregate over all connections; the work item checks the
+ * stream's own subscription, so kick it to stop (and drop the ref) when
+ * only that connection unsubscribed.
+ */
+static void stream_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    k_work_reschedule_for_queue(at24c32_workq(), &stream_work, K_NO_WAIT);
+}
+
+static ssize_t stats_stream_write(struct bt_conn *conn,
+                                  const struct bt_gatt_attr *attr,
+                                  const void *buf, uint16_t len,
+                                  uint16_t offset, uint8_t flags)
 {
     if (offset != 0)
         return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
-    if (len < 1)
+    if (len != 0 && len != STREAM_SEQ_LEN)
         return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
 
-    if (conn)
+    if (len == 0)
     {
-        uint16_t mtu = bt_gatt_get_mtu(conn);
-        uint16_t max_payload = (mtu > 3) ? (uint16_t)(mtu - 3u) : 0u;
-        if (len > max_payload)
+        if (stream_stop(conn))
         {
-            LOG_WRN("Schedule write refused: payload=%u > (MTU-3)=%u (MTU=%u). "
-                    "App must negotiate MTU >= %u.",
-                    len, max_payload, mtu, (uint16_t)(len + 3u));
-            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+            LOG_INF("stats stream: cancelled");
         }
+        return len;
     }
 
-    const uint8_t *p = buf;
-    const uint8_t count = p[0];
+    if (!bt_gatt_is_subscribed(conn, stream_attr(), BT_GATT_CCC_NOTIFY))
+    {
+        LOG_WRN("stats stream: notifications not enabled");
+        return BT_GATT_ERR(BT_ATT_ERR_WRITE_REQ_REJECTED);
+    }
+    const uint32_t seq = sys_get_le32(buf);
+
+    k_mutex_lock(&stream_lock, K_FOREVER);
+    const bool busy = stream_req.busy;
+    if (!busy)
+    {
+        stream_req.conn = conn;
+        stream_req.seq = seq;
+        stream_req.busy = true;
+        stream_req.start = true;
+        stream_req.stop = false;
+    }
+    k_mutex_unlock(&stream_lock);
+
+    if (busy)
+    {
+        /* One export at a time, whichever connection asked first */
+        return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+    }
+
+    LOG_INF("stats stream: start_seq=%u (first=%u head=%u)",
+            seq, stats_first_seq(), stats_head_seq());
+    k_work_reschedule_for_queue(at24c32_workq(), &stream_work, K_NO_WAIT);
+    return len;
+}
+
+static void ble_connected(struct bt_conn *conn, uint8_t err)
+{
+    if (err)
+        return;
+
+    struct conn_ctx *cc = ctx_of(conn);
+    cc->stats_start_seq = 0;
+    cc->stats_window = ST_MAX_RETURNED;
+    cc->stats_sync = false;
+    cc->cur.attr = NULL;
+    memset(cc->write_status, 0, sizeof(cc->write_status));
+}
+
+static void ble_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    cursor_drop(conn);
+    (void)stream_stop(conn);
+}
+
+BT_CONN_CB_DEFINE(ble_conn_cb) = {
+    .connected = ble_connected,
+    .disconnected = ble_disconnected,
+};
+
+/* Write status: [op u8][rc s8], rc 0 on success or a negative errno.
+ * Schedule and clock writes are only validated in the ATT callback; the
+ * EEPROM/RTC commit runs on the storage work queue and its outcome is
+ * reported here (readable, and notified when subscribed), to the
+ * connection that made the write only.
+ */
+enum
+{
+    WS_OP_SCHEDULE = 1,
+    WS_OP_TIME = 2,
+    WS_OP_BATCH = 3
+};
+
+static const struct bt_gatt_attr *write_status_attr(void);
+
+/* conn is the writer, ref'd when the command was queued; NULL for writes
+ * that did not come over a connection.
+ */
+static void write_status_report(struct bt_conn *conn, uint8_t op, int rc)
+{
+    if (!conn)
+        return;
+
+    const uint8_t ws[2] = {op, (uint8_t)(int8_t)CLAMP(rc, INT8_MIN, 0)};
+    memcpy(ctx_of(conn)->write_status, ws, sizeof(ws));
+
+    if (!bt_gatt_is_subscribed(conn, write_status_attr(), BT_GATT_CCC_NOTIFY))
+        return;
+
+    int err = bt_gatt_notify(conn, write_status_attr(), ws, sizeof(ws));
+    if (err && err != -ENOTCONN)
+    {
+        LOG_WRN("write status notify err %d", err);
+    }
+}
+
+static ssize_t write_status_read(struct bt_conn *conn,
+                                 const struct bt_gatt_attr *attr,
+                                 void *buf, uint16_t len, uint16_t offset)
+{
+    return bt_gatt_attr_read(conn, attr, buf, len, offset,
+                             ctx_of(conn)->write_status, sizeof(ctx_of(conn)->write_status));
+}
+
+/* One command buffer per characteristic; a second write while the first is
+ * still being committed is refused rather than queued. A batch write
+ * claims the buffers of the operations it carries. conn is the writer
+ * (ref held until its result is reported).
+ */
+static struct
+{
+    atomic_t busy;
+    struct bt_conn *conn;
+    struct sched_table table;
+} sched_cmd;
+
+static struct
+{
+    atomic_t busy;
+    struct bt_conn *conn;
+    struct tm t;
+} time_cmd;
+
+static inline struct bt_conn *writer_ref(struct bt_conn *conn)
+{
+    return conn ? bt_conn_ref(conn) : NULL;
+}
+
+/* Report to the writer and drop its ref; call after clearing busy */
+static void writer_report(struct bt_conn *conn, uint8_t op, int rc)
+{
+    write_status_report(conn, op, rc);
+    if (conn)
+        bt_conn_unref(conn);
+}
 
+/* Only the span that differs is rewritten; the caller re-arms the alarm */
+static int sched_commit(void)
+{
+    int rc = sched_set(&sched_cmd.table);
+    if (rc < 0)
+    {
+        LOG_ERR("sched_set failed rc=%d", rc);
+        return rc;
+    }
+
+    LOG_INF("Schedule updated: count=%u, %d bytes rewritten", sched_cmd.table.count, rc);
+    return 0;
+}
+
+static int time_commit(void)
+{
+    /* The alarm matches on a weekday taken from the date (see
+     * sched_next_fire_after), so the RTC's must agree with it whatever the
+     * client wrote in tm_wday.
+     */
+    tm_from_epoch(&time_cmd.t, tm_to_epoch(&time_cmd.t));
+
+    int rc = mcp7940n_set_time(mcp7940n_get(), &time_cmd.t);
+    if (rc)
+    {
+        LOG_ERR("mcp7940n_set_time failed: %d", rc);
+        return rc;
+    }
+
+    char tsbuf[100];
+    LOG_INF("RTC: %s", tm_to_str(&time_cmd.t, tsbuf, sizeof(tsbuf)));
+    return 0;
+}
+
+static void sched_cmd_handler(struct k_work *work)
+{
+    int rc = sched_commit();
+    if (rc == 0)
+    {
+        schedule_queue_sync_and_arm_next();
+        adv_status_changed();
+    }
+
+    struct bt_conn *conn = sched_cmd.conn;
+    sched_cmd.conn = NULL;
+    atomic_clear_bit(&sched_cmd.busy, 0);
+    writer_report(conn, WS_OP_SCHEDULE, rc);
+}
+
+static K_WORK_DEFINE(sched_cmd_work, sched_cmd_handler);
+
+static void time_cmd_handler(struct k_work *work)
+{
+    int rc = time_commit();
+    if (rc == 0)
+    {
+        schedule_queue_sync_and_arm_next();
+        adv_status_changed();
+    }
+
+    struct bt_conn *conn = time_cmd.conn;
+    time_cmd.conn = NULL;
+    atomic_clear_bit(&time_cmd.busy, 0);
+    writer_report(conn, WS_OP_TIME, rc);
+}
+
+static K_WORK_DEFINE(time_cmd_work, time_cmd_handler);
+
+/* Image, or [count u8] then count rules or old entries (see SCH_HDR) */
+static int sched_parse(const uint8_t *p, uint16_t len, struct sched_table *t)
+{
+    if (len < SCH_HDR)
+        return -EMSGSIZE;
+
+    const uint8_t count = p[0];
     if (count > SCHED_CAP)
     {
         LOG_WRN("Schedule write: count=%u > cap=%u", count, SCHED_CAP);
-        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        return -ERANGE;
     }
 
-    const uint32_t expect = (uint32_t)SCH_HDR + (uint32_t)count * SCH_ENTRY;
-    if (len != expect)
+    if ((len & 1u) == 0)
     {
-        LOG_WRN("Schedule write: len=%u expect=%u (count=%u)", len, (unsigned)expect, count);
-        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+        int rc = sched_table_from_image(t, p, len);
+        if (rc)
+            LOG_WRN("Schedule write: bad image len=%u count=%u (%d)", len, count, rc);
+        return rc;
+    }
+
+    const bool rules = (len == (uint32_t)SCH_HDR + (uint32_t)count * SCH_RULE);
+    if (!rules && len != (uint32_t)SCH_HDR + (uint32_t)count * SCH_ENTRY)
+    {
+        LOG_WRN("Schedule write: len=%u does not fit count=%u", len, count);
+        return -EMSGSIZE;
     }
 
-    // Validate all entries first
+    memset(t, 0, sizeof(*t));
     for (uint8_t i = 0; i < count; ++i)
     {
-        const uint8_t *e = &p[SCH_HDR + (uint32_t)i * SCH_ENTRY];
-        struct tm t = {0};
-        tm_from_7(&t, e);
-        if (!tm_sane(&t))
+        int rc;
+        if (rules)
         {
-            LOG_WRN("Schedule write: invalid time at idx=%u", i);
-            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+            const struct sched_rule *r = (const struct sched_rule *)&p[SCH_HDR + (uint32_t)i * SCH_RULE];
+            rc = sched_rule_valid(r)
+                     ? sched_table_add(t, (uint16_t)(r->hour * 60u + r->min), r->int2b, r->days)
+                     : -ERANGE;
+        }
+        else
+        {
+            const uint8_t *e = &p[SCH_HDR + (uint32_t)i * SCH_ENTRY];
+            struct tm tm = {0};
+            tm_from_7(&tm, e);
+            rc = tm_sane(&tm) ? sched_table_add(t, sched_entry_minute(e), e[SCH_ENTRY - 1] & 0x03u,
+                                                SCHED_DAYS_ALL)
+                              : -ERANGE;
+        }
+
+        if (rc)
+        {
+            LOG_WRN("Schedule write: invalid entry at idx=%u", i);
+            return rc;
         }
     }
+    return 0;
+}
 
-    sched_clear();
-    for (uint8_t i = 0; i < count; ++i)
+static int sched_validate(const uint8_t *p, uint16_t len)
+{
+    struct sched_table t;
+    return sched_parse(p, len, &t);
+}
+
+/* Caller holds sched_cmd.busy; p passed sched_validate() */
+static void sched_load(const uint8_t *p, uint16_t len)
+{
+    (void)sched_parse(p, len, &sched_cmd.table);
+}
+
+int ble_schedule_submit(struct bt_conn *conn, const uint8_t *p, uint16_t len)
+{
+    int rc = sched_validate(p, len);
+    if (rc)
+        return rc;
+
+    if (atomic_test_and_set_bit(&sched_cmd.busy, 0))
+    {
+        LOG_WRN("Schedule write: previous write still committing");
+        return -EBUSY;
+    }
+
+    sched_load(p, len);
+    sched_cmd.conn = writer_ref(conn);
+    k_work_submit_to_queue(at24c32_workq(), &sched_cmd_work);
+    return 0;
+}
+
+static ssize_t schedule_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (offset != 0)
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    if (len < 1)
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+
+    if (conn)
     {
-        const uint8_t *e = &p[SCH_HDR + (uint32_t)i * SCH_ENTRY];
-        const uint8_t inten = (uint8_t)(e[7] & 0x03);
-        int r = sched_append(e, inten);
-        if (r < 0)
+        link_bulk(conn);
+
+        uint16_t mtu = bt_gatt_get_mtu(conn);
+        uint16_t max_payload = (mtu > 3) ? (uint16_t)(mtu - 3u) : 0u;
+        if (len > max_payload)
         {
-            LOG_ERR("sched_append failed at %u rc=%d", i, r);
-            return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+            LOG_WRN("Schedule write refused: payload=%u > (MTU-3)=%u (MTU=%u). "
+                    "MTU exchange not done yet? Need MTU >= %u.",
+                    len, max_payload, mtu, (uint16_t)(len + 3u));
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
         }
     }
-    schedule_queue_clear();
-    schedule_queue_sync_and_arm_next();
 
-    LOG_INF("Schedule updated: count=%u (single-shot write)", count);
-    return len;
+    switch (ble_schedule_submit(conn, buf, len))
+    {
+    case 0:
+        return len;
+    case -ERANGE:
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    case -EBUSY:
+        return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+    default:
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
 }
 
 static ssize_t gadi_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
@@ -369,24 +1070,20 @@ static ssize_t gadi_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
     else if (rc)
         return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
 
-    struct mcp7940n *rtc = mcp7940n_get();
-    if (!rtc)
+    if (!mcp7940n_get())
     {
         LOG_ERR("mcp7940n_get() returned NULL; not bound yet");
         return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
     }
 
-    rc = mcp7940n_set_time(rtc, &t);
-    if (rc)
+    if (atomic_test_and_set_bit(&time_cmd.busy, 0))
     {
-        LOG_ERR("mcp7940n_set_time failed: %d", rc);
-        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+        return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
     }
 
-    char tsbuf[100];
-    LOG_INF("RTC: %s", tm_to_str(&t, tsbuf, sizeof(tsbuf)));
-
-    schedule_queue_sync_and_arm_next();
+    time_cmd.t = t;
+    time_cmd.conn = writer_ref(conn);
+    k_work_submit_to_queue(at24c32_workq(), &time_cmd_work);
 
     return len;
 }
@@ -411,6 +1108,250 @@ static ssize_t remote_spray_write(struct bt_conn *conn,
     return len;
 }
 
+/* Batch write: several operations in one ATT write (TLVs in ble.h), e.g.
+ * time, schedule and statistics window when provisioning. Every TLV is
+ * validated before anything is applied, so a bad one refuses the whole
+ * write. Statistics and spray act at once, like their own writes; time
+ * then schedule are committed in one work item with a single queue sync
+ * and alarm re-arm at the end. The commit result (from the first step
+ * that failed) is reported on Write Status as WS_OP_BATCH.
+ */
+static struct
+{
+    atomic_t busy;
+    struct bt_conn *conn;
+    bool time;
+    bool sched;
+} batch_cmd;
+
+static void batch_cmd_handler(struct k_work *work)
+{
+    int rc = 0;
+    bool changed = false;
+
+    if (batch_cmd.time)
+    {
+        rc = time_commit();
+        changed = (rc == 0);
+    }
+    if (batch_cmd.sched && rc == 0)
+    {
+        rc = sched_commit();
+        changed = changed || (rc == 0);
+    }
+    if (changed)
+    {
+        schedule_queue_sync_and_arm_next();
+        adv_status_changed();
+    }
+
+    if (batch_cmd.time)
+        atomic_clear_bit(&time_cmd.busy, 0);
+    if (batch_cmd.sched)
+        atomic_clear_bit(&sched_cmd.busy, 0);
+    struct bt_conn *conn = batch_cmd.conn;
+    batch_cmd.conn = NULL;
+    atomic_clear_bit(&batch_cmd.busy, 0);
+    writer_report(conn, WS_OP_BATCH, rc);
+}
+
+static K_WORK_DEFINE(batch_cmd_work, batch_cmd_handler);
+
+/* Take the batch buffer and the command buffers it will fill, or none */
+static bool batch_claim(bool time, bool sched)
+{
+    if (atomic_test_and_set_bit(&batch_cmd.busy, 0))
+        return false;
+    if (time && atomic_test_and_set_bit(&time_cmd.busy, 0))
+    {
+        atomic_clear_bit(&batch_cmd.busy, 0);
+        return false;
+    }
+    if (sched && atomic_test_and_set_bit(&sched_cmd.busy, 0))
+    {
+        if (time)
+            atomic_clear_bit(&time_cmd.busy, 0);
+        atomic_clear_bit(&batch_cmd.busy, 0);
+        return false;
+    }
+    return true;
+}
+
+static int batch_validate(uint8_t type, const uint8_t *v, uint16_t len, struct tm *t)
+{
+    switch (type)
+    {
+    case BLE_TLV_TIME:
+        return parse_gadi_time_payload(v, len, t);
+    case BLE_TLV_SCHEDULE:
+        return sched_validate(v, len);
+    case BLE_TLV_STATS:
+        return (len == 2 || len == 4 || len == 5) ? 0 : -EMSGSIZE;
+    case BLE_TLV_SPRAY:
+        return (len == 1) ? 0 : -EMSGSIZE;
+    default:
+        return -ERANGE;
+    }
+}
+
+static ssize_t batch_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                           const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (offset != 0)
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    if (len == 0)
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+
+    const uint8_t *p = buf;
+    const uint8_t *val[BLE_TLV_COUNT] = {0};
+    uint16_t val_len[BLE_TLV_COUNT] = {0};
+    struct tm t;
+
+    for (uint16_t off = 0; off < len;)
+    {
+        if (len - off < BLE_TLV_HDR_LEN)
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+
+        const uint8_t type = p[off];
+        const uint16_t n = sys_get_le16(&p[off + 1]);
+        off += BLE_TLV_HDR_LEN;
+        if (n > len - off)
+            return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+
+        if (type < BLE_TLV_COUNT && val[type])
+        {
+            LOG_WRN("Batch: TLV 0x%02x repeated", type);
+            return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+
+        int rc = batch_validate(type, &p[off], n, &t);
+        if (rc)
+        {
+            LOG_WRN("Batch: TLV 0x%02x len=%u refused (%d)", type, n, rc);
+            return (rc == -EMSGSIZE) ? BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN)
+                                     : BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+        }
+        val[type] = &p[off];
+        val_len[type] = n;
+        off += n;
+    }
+
+    const bool time = (val[BLE_TLV_TIME] != NULL);
+    const bool sched = (val[BLE_TLV_SCHEDULE] != NULL);
+
+    if (time && !mcp7940n_get())
+    {
+        LOG_ERR("mcp7940n_get() returned NULL; not bound yet");
+        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+    }
+    if ((time || sched) && !batch_claim(time, sched))
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+    }
+
+    if (val[BLE_TLV_STATS])
+    {
+        (void)stats_ctrl_apply(conn, val[BLE_TLV_STATS], val_len[BLE_TLV_STATS]);
+    }
+    if (val[BLE_TLV_SPRAY])
+    {
+        ble_spray_caller((uint8_t)(*val[BLE_TLV_SPRAY] & 0x03));
+    }
+    if (time || sched)
+    {
+        batch_cmd.time = time;
+        batch_cmd.sched = sched;
+        batch_cmd.conn = writer_ref(conn);
+        if (time)
+            time_cmd.t = t;
+        if (sched)
+            sched_load(val[BLE_TLV_SCHEDULE], val_len[BLE_TLV_SCHEDULE]);
+        k_work_submit_to_queue(at24c32_workq(), &batch_cmd_work);
+    }
+
+    LOG_INF("Batch: time=%d schedule=%d stats=%d spray=%d", time, sched,
+            val[BLE_TLV_STATS] != NULL, val[BLE_TLV_SPRAY] != NULL);
+    return len;
+}
+
+/* Cycle state: [phase u8][remaining_ms u16][cycle_index u16][seq_state u8].
+ * Notified on every phase/sequence transition, not on remaining_ms ticks;
+ * a client wanting a countdown extrapolates from the last value.
+ */
+enum
+{
+    CS_LEN = 6
+};
+
+static bool cycle_state_subscribed;
+
+static void cycle_state_build(uint8_t out[CS_LEN])
+{
+    struct cycle_state_t st;
+    cycle_get_state(&st);
+
+    out[0] = st.phase;
+    sys_put_le16(st.remaining_ms, &out[1]);
+    sys_put_le16(st.cycle_index, &out[3]);
+    out[5] = spray_get_state();
+}
+
+static ssize_t cycle_state_read(struct bt_conn *conn,
+                                const struct bt_gatt_attr *attr,
+                                void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t v[CS_LEN];
+    cycle_state_build(v);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, v, sizeof(v));
+}
+
+static const struct bt_gatt_attr *cycle_state_attr(void);
+
+/* Transitions can come from timer ISRs; a k_work both moves the notify to
+ * thread context and coalesces bursts into one packet.
+ */
+static void cycle_state_work_handler(struct k_work *work)
+{
+    if (!cycle_state_subscribed)
+        return;
+
+    uint8_t v[CS_LEN];
+    cycle_state_build(v);
+    int err = bt_gatt_notify(NULL, cycle_state_attr(), v, sizeof(v));
+    if (err && err != -ENOTCONN)
+    {
+        LOG_WRN("cycle state notify err %d", err);
+    }
+}
+
+static K_WORK_DEFINE(cycle_state_work, cycle_state_work_handler);
+
+void ble_cycle_state_notify(void)
+{
+    if (cycle_state_subscribed)
+    {
+        k_work_submit(&cycle_state_work);
+    }
+}
+
+static void cycle_state_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    cycle_state_subscribed = (value == BT_GATT_CCC_NOTIFY);
+}
+
+/* Rollups read: the fixed image described in rollups.h (long read for
+ * the whole thing).
+ */
+static ssize_t rollups_chr_read(struct bt_conn *conn,
+                                const struct bt_gatt_attr *attr,
+                                void *buf, uint16_t len, uint16_t offset)
+{
+    if (offset > ROLLUP_TOTAL_LEN)
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+
+    return (ssize_t)rollups_read(offset, buf, len);
+}
+
 BT_GATT_SERVICE_DEFINE(
     machhar_svc,
     BT_GATT_PRIMARY_SERVICE(BT_UUID_MACHHAR_SERVICE),
@@ -429,9 +1370,65 @@ BT_GATT_SERVICE_DEFINE(
     BT_GATT_CHARACTERISTIC(BT_UUID_MACHHAR_REMOTE_SPRAY,
                            BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
                            BT_GATT_PERM_WRITE,
-                           NULL, remote_spray_write, NULL)
+                           NULL, remote_spray_write, NULL),
+    BT_GATT_CHARACTERISTIC(BT_UUID_MACHHAR_ROLLUPS,
+                           BT_GATT_CHRC_READ,
+                           BT_GATT_PERM_READ,
+                           rollups_chr_read, NULL, NULL),
+    BT_GATT_CHARACTERISTIC(BT_UUID_MACHHAR_STATS_STREAM,
+                           BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_WRITE,
+                           NULL, stats_stream_write, NULL),
+    BT_GATT_CCC(stream_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_MACHHAR_CYCLE_STATE,
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_READ,
+                           cycle_state_read, NULL, NULL),
+    BT_GATT_CCC(cycle_state_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_MACHHAR_WRITE_STATUS,
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_READ,
+                           write_status_read, NULL, NULL),
+    BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+    BT_GATT_CHARACTERISTIC(BT_UUID_MACHHAR_BATCH,
+                           BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_WRITE,
+                           NULL, batch_write, NULL)
 
     /* If you add notify on any of the above, put a CCC **right after** that char:
     BT_GATT_CCC(on_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
     */
-);
\ No newline at end of file
+);
+
+static const struct bt_gatt_attr *stream_attr(void)
+{
+    static const struct bt_gatt_attr *attr;
+    if (!attr)
+    {
+        attr = bt_gatt_find_by_uuid(machhar_svc.attrs, machhar_svc.attr_count,
+                                    BT_UUID_MACHHAR_STATS_STREAM);
+    }
+    return attr;
+}
+
+static const struct bt_gatt_attr *cycle_state_attr(void)
+{
+    static const struct bt_gatt_attr *attr;
+    if (!attr)
+    {
+        attr = bt_gatt_find_by_uuid(machhar_svc.attrs, machhar_svc.attr_count,
+                                    BT_UUID_MACHHAR_CYCLE_STATE);
+    }
+    return attr;
+}
+
+static const struct bt_gatt_attr *write_status_attr(void)
+{
+    static const struct bt_gatt_attr *attr;
+    if (!attr)
+    {
+        attr = bt_gatt_find_by_uuid(machhar_svc.attrs, machhar_svc.attr_count,
+                                    BT_UUID_MACHHAR_WRITE_STATUS);
+    }
+    return attr;
+}
@@ -0,0 +1,334 @@
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+
+#include "bulk.h"
+#include "ble.h"
+#include "link.h"
+#include "stats.h"
+#include "schedule.h"
+#include "at24c32.h"
+#include "settings_ee.h"
+
+LOG_MODULE_REGISTER(bulk, LOG_LEVEL_INF);
+
+/* Largest command is a full schedule upload */
+#define BULK_RX_MTU MAX(23u, 1u + SCHED_TOTAL_LEN)
+#define BULK_TX_BUFS 4u
+#define ST_PREFIX 8u /* [start_seq][head_seq] ahead of the stats entries */
+
+BUILD_ASSERT(BULK_SDU_MAX >= BULK_RSP_HDR_LEN + ST_PREFIX + sizeof(struct stats_entry),
+             "first SDU must hold the reply header and the stats prefix");
+
+/* Replies are produced on the AT24C32 work queue (every body comes from the
+ * EEPROM), one SDU per buffer. When the TX pool runs dry the work returns
+ * and the next buffer freed resumes it, so the pool size bounds what sits
+ * in the stack and the peer's credits pace the rest.
+ */
+static void tx_destroy(struct net_buf *buf);
+
+NET_BUF_POOL_FIXED_DEFINE(bulk_tx_pool, BULK_TX_BUFS, BT_L2CAP_SDU_BUF_SIZE(BULK_SDU_MAX),
+                          CONFIG_BT_CONN_TX_USER_DATA_SIZE, tx_destroy);
+NET_BUF_POOL_FIXED_DEFINE(bulk_rx_pool, CONFIG_BT_MAX_CONN, BT_L2CAP_SDU_BUF_SIZE(BULK_RX_MTU),
+                          8, NULL);
+
+struct bulk_chan
+{
+    struct bt_l2cap_le_chan le;
+    struct k_work work;
+    atomic_t busy; /* bit 0: a reply is streaming */
+
+    /* Set by recv() before the work is submitted, then owned by the work */
+    uint8_t cmd;
+    int8_t status;
+    bool hdr_sent;
+    uint32_t len;  /* body bytes */
+    uint32_t done; /* body bytes queued */
+    uint32_t seq;  /* STATS: since_seq, then the next seq to send */
+    uint32_t head; /* STATS */
+    uint16_t addr; /* EEPROM */
+};
+
+static struct bulk_chan chans[CONFIG_BT_MAX_CONN];
+
+static void reply_done(struct bulk_chan *bc)
+{
+    LOG_INF("bulk cmd 0x%02x: %u bytes, status %d", bc->cmd, bc->done, bc->status);
+    atomic_clear_bit(&bc->busy, 0);
+}
+
+/* Runs with hdr_sent still false, before the first byte goes out */
+static void stats_freeze(struct bulk_chan *bc)
+{
+    uint32_t first, head;
+    stats_bounds(&first, &head);
+    uint32_t start = bc->seq;
+    if (start - first > head - first)
+        start = (start > head) ? head : first;
+
+    bc->seq = start;
+    bc->head = head;
+    bc->len = ST_PREFIX + (head - start) * sizeof(struct stats_entry);
+}
+
+static void stats_fill(struct bulk_chan *bc, struct net_buf *buf, uint32_t room)
+{
+    if (bc->done == 0)
+    {
+        net_buf_add_le32(buf, bc->seq);
+        net_buf_add_le32(buf, bc->head);
+        bc->done = ST_PREFIX;
+        room -= ST_PREFIX;
+    }
+
+    const uint32_t left = bc->head - bc->seq;
+    const uint8_t k = (uint8_t)MIN(MIN(room / sizeof(struct stats_entry), left), UINT8_MAX);
+    struct stats_entry *e = net_buf_add(buf, (size_t)k * sizeof(*e));
+
+    uint8_t got = stats_get_range(bc->seq, k, e);
+    if (got < k)
+    {
+        /* Overwritten since the export started */
+        memset(&e[got], 0, (size_t)(k - got) * sizeof(*e));
+    }
+    bc->seq += k;
+    bc->done += (uint32_t)k * sizeof(*e);
+}
+
+static int eeprom_fill(struct bulk_chan *bc, struct net_buf *buf, uint32_t room)
+{
+    const uint16_t k = (uint16_t)MIN(room, bc->len - bc->done);
+    uint8_t *dst = net_buf_add(buf, k);
+
+    const uint32_t a = bc->addr + bc->done;
+    if (at24c32_read_bytes((uint16_t)a, dst, k))
+        return -EIO;
+
+    /* The compaction journal can hold copies of bond keys */
+    const uint32_t lo = MAX(a, (uint32_t)SETTINGS_EE_JRNL_BASE);
+    const uint32_t hi = MIN(a + k, (uint32_t)SETTINGS_EE_JRNL_BASE + SETTINGS_EE_JRNL_LEN);
+    if (lo < hi)
+        memset(&dst[lo - a], 0xFF, hi - lo);
+
+    bc->done += k;
+    return 0;
+}
+
+static void bulk_work_handler(struct k_work *work)
+{
+    struct bulk_chan *bc = CONTAINER_OF(work, struct bulk_chan, work);
+
+    while (atomic_test_bit(&bc->busy, 0))
+    {
+        struct bt_conn *conn = bc->le.chan.conn;
+        if (!conn)
+        {
+            reply_done(bc);
+            return;
+        }
+
+        struct net_buf *buf = net_buf_alloc(&bulk_tx_pool, K_NO_WAIT);
+        if (!buf)
+            return;
+        net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+
+        uint32_t room = MIN(bc->le.tx.mtu, BULK_SDU_MAX);
+        if (!bc->hdr_sent)
+        {
+            if (bc->cmd == BULK_CMD_STATS && bc->status == 0)
+                stats_freeze(bc);
+            net_buf_add_u8(buf, bc->cmd);
+            net_buf_add_u8(buf, (uint8_t)bc->status);
+            net_buf_add_le32(buf, bc->len);
+            bc->hdr_sent = true;
+            room -= BULK_RSP_HDR_LEN;
+        }
+
+        if (bc->done < bc->len)
+        {
+            if (bc->cmd == BULK_CMD_STATS)
+            {
+                stats_fill(bc, buf, room);
+            }
+            else if (eeprom_fill(bc, buf, room))
+            {
+                /* The header already promised len bytes; cut the channel so
+                 * the client sees a short reply instead of a bad image.
+                 */
+                LOG_ERR("bulk: EEPROM read failed at 0x%04x", bc->addr + bc->done);
+                net_buf_unref(buf);
+                bt_l2cap_chan_disconnect(&bc->le.chan);
+                reply_done(bc);
+                return;
+            }
+        }
+
+        link_bulk(conn);
+        int err = bt_l2cap_chan_send(&bc->le.chan, buf);
+        if (err < 0)
+        {
+            LOG_WRN("bt_l2cap_chan_send err %d", err);
+            net_buf_unref(buf);
+            reply_done(bc);
+            return;
+        }
+
+        if (bc->done >= bc->len)
+        {
+            /* busy is free for the next command from here on */
+            reply_done(bc);
+            return;
+        }
+    }
+}
+
+static int parse_cmd(struct bulk_chan *bc, struct bt_conn *conn, const uint8_t *p, uint16_t len)
+{
+    switch (p[0])
+    {
+    case BULK_CMD_STATS:
+        if (len != 5)
+            return -EMSGSIZE;
+        bc->seq = sys_get_le32(&p[1]);
+        return 0;
+
+    case BULK_CMD_EEPROM:
+    {
+        if (len != 5)
+            return -EMSGSIZE;
+        const uint16_t addr = sys_get_le16(&p[1]);
+        uint16_t n = sys_get_le16(&p[3]);
+        if (addr >= AT24C32_SIZE)
+            return -ERANGE;
+        if (n == 0 || n > AT24C32_SIZE - addr)
+            n = (uint16_t)(AT24C32_SIZE - addr);
+        /* Bond keys and CCC state live in the settings log */
+        if (addr < SETTINGS_EE_BASE + SETTINGS_EE_LEN && addr + n > SETTINGS_EE_BASE)
+            return -EACCES;
+        bc->addr = addr;
+        bc->len = n;
+        return 0;
+    }
+
+    case BULK_CMD_SCHEDULE:
+        return ble_schedule_submit(conn, &p[1], (uint16_t)(len - 1u));
+
+    default:
+        return -EINVAL;
+    }
+}
+
+static int bulk_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    struct bulk_chan *bc = CONTAINER_OF(BT_L2CAP_LE_CHAN(chan), struct bulk_chan, le);
+
+    if (buf->len < 1)
+        return 0;
+    /* The work may still be unwinding after reply_done() cleared busy */
+    if (k_work_busy_get(&bc->work) || atomic_test_and_set_bit(&bc->busy, 0))
+    {
+        LOG_WRN("bulk: cmd 0x%02x dropped, reply still streaming", buf->data[0]);
+        return 0;
+    }
+
+    bc->cmd = buf->data[0];
+    bc->hdr_sent = false;
+    bc->len = 0;
+    bc->done = 0;
+    bc->status = (int8_t)parse_cmd(bc, chan->conn, buf->data, buf->len);
+    if (bc->status)
+    {
+        bc->len = 0;
+        LOG_WRN("bulk: cmd 0x%02x len %u refused (%d)", bc->cmd, buf->len, bc->status);
+    }
+
+    link_bulk(chan->conn);
+    k_work_submit_to_queue(at24c32_workq(), &bc->work);
+    return 0;
+}
+
+static void tx_destroy(struct net_buf *buf)
+{
+    net_buf_destroy(buf);
+
+    /* Resume every reply stalled on the shared pool */
+    for (size_t i = 0; i < ARRAY_SIZE(chans); ++i)
+    {
+        if (atomic_test_bit(&chans[i].busy, 0))
+        {
+            k_work_submit_to_queue(at24c32_workq(), &chans[i].work);
+        }
+    }
+}
+
+static struct net_buf *bulk_alloc_buf(struct bt_l2cap_chan *chan)
+{
+    return net_buf_alloc(&bulk_rx_pool, K_NO_WAIT);
+}
+
+static void bulk_connected(struct bt_l2cap_chan *chan)
+{
+    struct bt_l2cap_le_chan *le = BT_L2CAP_LE_CHAN(chan);
+    LOG_INF("bulk channel up: tx mtu %u mps %u, rx mtu %u", le->tx.mtu, le->tx.mps, le->rx.mtu);
+}
+
+static void bulk_disconnected(struct bt_l2cap_chan *chan)
+{
+    struct bulk_chan *bc = CONTAINER_OF(BT_L2CAP_LE_CHAN(chan), struct bulk_chan, le);
+    atomic_clear_bit(&bc->busy, 0);
+    LOG_INF("bulk channel down");
+}
+
+static const struct bt_l2cap_chan_ops bulk_ops = {
+    .connected = bulk_connected,
+    .disconnected = bulk_disconnected,
+    .recv = bulk_recv,
+    .alloc_buf = bulk_alloc_buf,
+};
+
+static int bulk_accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+                       struct bt_l2cap_chan **chan)
+{
+    struct bulk_chan *bc = &chans[bt_conn_index(conn)];
+
+    if (bc->le.chan.conn)
+    {
+        LOG_WRN("bulk: channel already open on this connection");
+        return -ENOMEM;
+    }
+
+    memset(&bc->le, 0, sizeof(bc->le));
+    bc->le.chan.ops = &bulk_ops;
+    bc->le.rx.mtu = BULK_RX_MTU;
+    atomic_clear_bit(&bc->busy, 0);
+    *chan = &bc->le.chan;
+    return 0;
+}
+
+static struct bt_l2cap_server bulk_server = {
+    .psm = BULK_PSM,
+    .sec_level = BT_SECURITY_L2,
+    .accept = bulk_accept,
+};
+
+int bulk_init(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(chans); ++i)
+    {
+        k_work_init(&chans[i].work, bulk_work_handler);
+    }
+
+    int err = bt_l2cap_server_register(&bulk_server);
+    if (err)
+    {
+        LOG_ERR("bt_l2cap_server_register err %d", err);
+        return err;
+    }
+    LOG_INF("bulk channel on PSM 0x%04x", BULK_PSM);
+    return 0;
+}
@@ -17,8 +17,18 @@ static bool s_running = false;
 static bool s_paused = false;
 static int32_t s_phase_end_ms = 0;
 
+static cycle_state_cb_t s_state_cb = NULL;
+
 static inline int32_t now_ms(void) { return (int32_t)k_uptime_get_32(); }
 
+static void state_changed(void)
+{
+    if (s_state_cb)
+    {
+        s_state_cb(&s_state);
+    }
+}
+
 static void enter_spray(void)
 {
     s_state.phase = 1;
@@ -26,6 +36,7 @@ static void enter_spray(void)
     s_phase_end_ms = now_ms() + s_cfg.spray_ms;
     s_state.remaining_ms = s_cfg.spray_ms;
     LOG_INF("SPRAY for %u ms", s_cfg.spray_ms);
+    state_changed();
 }
 
 static void enter_idle(void)
@@ -35,6 +46,7 @@ static void enter_idle(void)
     s_phase_end_ms = now_ms() + s_cfg.idle_ms;
     s_state.remaining_ms = s_cfg.idle_ms;
     LOG_INF("IDLE for %u ms", s_cfg.idle_ms);
+    state_changed();
 }
 
 static void tick_work(struct k_work *w);
@@ -62,6 +74,7 @@ static void tick_work(struct k_work *w)
                     s_state.remaining_ms = 0;
                     servo_set_deg(IDLE_DEG);
                     LOG_INF("DONE. Ran %u cycles.", s_state.cycle_index);
+                    state_changed();
                 }
                 else
                 {
@@ -80,6 +93,8 @@ int cycle_init(void)
     return 0;
 }
 
+void cycle_set_state_callback(cycle_state_cb_t cb) { s_state_cb = cb; }
+
 void cycle_tick_start(void) { k_work_schedule(&cycle_work, K_MSEC(100)); }
 void cycle_tick_stop(void) { k_work_cancel_delayable(&cycle_work); }
 
@@ -115,6 +130,7 @@ void cycle_stop(void)
     s_state.remaining_ms = 0;
     servo_set_deg(IDLE_DEG);
     LOG_INF("STOP");
+    state_changed();
 }
 
 void cycle_pause(void)
@@ -124,6 +140,7 @@ void cycle_pause(void)
         s_paused = true;
         s_state.phase = 3;
         LOG_INF("PAUSE");
+        state_changed();
     }
 }
 
@@ -133,5 +150,6 @@ void cycle_resume(void)
     {
         s_paused = false;
         LOG_INF("RESUME");
+        state_changed();
     }
 }
@@ -0,0 +1,160 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "link.h"
+
+LOG_MODULE_REGISTER(link, LOG_LEVEL_INF);
+
+struct link_state
+{
+    struct bt_conn *conn; /* NULL = slot unused */
+    bool bulk;
+    bool bulk_tried; /* bulk interval requested (maybe refused) since the last idle */
+    struct k_work_delayable idle_work;
+    struct bt_gatt_exchange_params mtu_params;
+};
+
+static struct link_state links[CONFIG_BT_MAX_CONN];
+
+static int set_interval(struct link_state *ls, bool bulk)
+{
+    const struct bt_le_conn_param *param =
+        bulk ? BT_LE_CONN_PARAM(LINK_BULK_INT_MIN, LINK_BULK_INT_MAX, 0, LINK_SUP_TIMEOUT)
+             : BT_LE_CONN_PARAM(LINK_IDLE_INT_MIN, LINK_IDLE_INT_MAX, LINK_IDLE_LATENCY,
+                                LINK_SUP_TIMEOUT);
+
+    int err = bt_conn_le_param_update(ls->conn, param);
+    if (err && err != -EALREADY)
+    {
+        LOG_WRN("conn param update (%s) failed: %d", bulk ? "bulk" : "idle", err);
+        return err;
+    }
+    ls->bulk = bulk;
+    return 0;
+}
+
+static void idle_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct link_state *ls = CONTAINER_OF(dwork, struct link_state, idle_work);
+
+    if (!ls->conn)
+        return;
+
+    // A refused bulk request gets retried by the next transfer
+    ls->bulk_tried = false;
+    if (ls->bulk)
+    {
+        LOG_INF("link idle, relaxing interval");
+        (void)set_interval(ls, false);
+    }
+}
+
+void link_bulk(struct bt_conn *conn)
+{
+    if (!conn)
+        return;
+
+    struct link_state *ls = &links[bt_conn_index(conn)];
+    if (ls->conn != conn)
+        return;
+
+    // Called per PDU; a refused request is not repeated until idle
+    if (!ls->bulk && !ls->bulk_tried)
+    {
+        LOG_INF("link bulk mode");
+        ls->bulk_tried = true;
+        (void)set_interval(ls, true);
+    }
+    k_work_reschedule(&ls->idle_work, K_MSEC(LINK_IDLE_AFTER_MS));
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+                          struct bt_gatt_exchange_params *params)
+{
+    LOG_INF("MTU exchange %s, MTU=%u", err ? "failed" : "done", bt_gatt_get_mtu(conn));
+}
+
+static void on_connected(struct bt_conn *conn, uint8_t err)
+{
+    if (err)
+        return;
+
+    struct link_state *ls = &links[bt_conn_index(conn)];
+    ls->conn = bt_conn_ref(conn);
+    ls->bulk = false;
+    ls->bulk_tried = false;
+    k_work_init_delayable(&ls->idle_work, idle_work_handler);
+
+    // Each request is independent; a peer that refuses one keeps the rest.
+    ls->mtu_params.func = mtu_exchanged;
+    int rc = bt_gatt_exchange_mtu(conn, &ls->mtu_params);
+    if (rc)
+    {
+        LOG_WRN("MTU exchange request failed: %d", rc);
+    }
+
+    rc = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (rc)
+    {
+        LOG_WRN("data length update failed: %d", rc);
+    }
+
+    rc = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+    if (rc)
+    {
+        LOG_WRN("PHY update failed: %d", rc);
+    }
+
+    // Service discovery and the first sync follow right away
+    link_bulk(conn);
+}
+
+static void on_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    struct link_state *ls = &links[bt_conn_index(conn)];
+    if (ls->conn != conn)
+        return;
+
+    k_work_cancel_delayable(&ls->idle_work);
+    bt_conn_unref(ls->conn);
+    ls->conn = NULL;
+    ls->bulk = false;
+    ls->bulk_tried = false;
+}
+
+static void on_param_updated(struct bt_conn *conn, uint16_t interval,
+                             uint16_t latency, uint16_t timeout)
+{
+    struct link_state *ls = &links[bt_conn_index(conn)];
+    if (ls->conn == conn)
+    {
+        // The link changed under us; the next transfer may ask again
+        ls->bulk_tried = false;
+    }
+
+    LOG_INF("conn params: interval=%u.%02u ms latency=%u timeout=%u ms",
+            (interval * 125u) / 100u, (interval * 125u) % 100u, latency, timeout * 10u);
+}
+
+static void on_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *info)
+{
+    LOG_INF("PHY: tx=%u rx=%u", info->tx_phy, info->rx_phy);
+}
+
+static void on_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+    LOG_INF("data length: tx=%u/%uus rx=%u/%uus",
+            info->tx_max_len, info->tx_max_time, info->rx_max_len, info->rx_max_time);
+}
+
+BT_CONN_CB_DEFINE(link_conn_cb) = {
+    .connected = on_connected,
+    .disconnected = on_disconnected,
+    .le_param_updated = on_param_updated,
+    .le_phy_updated = on_phy_updated,
+    .le_data_len_updated = on_data_len_updated,
+};
@@ -5,7 +5,10 @@
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/settings/settings.h>
 #include "ble.h"
+#include "adv.h"
+#include "bulk.h"
 #include "cycle.h"
 #include "vbat.h"
 #include "spray.h"
@@ -13,6 +16,7 @@
 #include "mcp7940n.h"
 #include "tm_helpers.h"
 #include "stats.h"
+#include "rollups.h"
 #include "schedule_queue.h"
 #include "schedule.h"
 #include "led_ctrl.h"
@@ -53,56 +57,9 @@ static void seed_time_from_build_if_needed(void)
     }
 }
 
-static const struct bt_le_adv_param *adv_param = BT_LE_ADV_PARAM(
-    (BT_LE_ADV_OPT_CONN | BT_LE_ADV_OPT_USE_IDENTITY),
-    800, 801, NULL);
-
-#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
-
 #define RUN_LED_BLINK_INTERVAL 1000
 
-static const struct bt_data ad[] = {
-    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-};
-
-static const struct bt_data sd[] = {
-    BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_MACHHAR_SERVICE_VAL),
-};
-
-static bool is_connected = false;
-static bool is_advertising = false;
-
-static struct k_work adv_work;
-static struct k_work_delayable adv_stop_work;
-
-static void advertising_start(void);
-
-static void adv_stop_work_handler(struct k_work *work)
-{
-    int err = bt_le_adv_stop();
-    if (err && err != -EALREADY)
-    {
-        LOG_ERR("bt_le_adv_stop err %d", err);
-        return;
-    }
-    is_advertising = false;
-    LOG_INF("Advertising stopped (timeout)");
-}
-
-static void adv_work_handler(struct k_work *work)
-{
-    int err = bt_le_adv_start(adv_param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
-    if (err)
-    {
-        LOG_ERR("bt_le_adv_start err %d", err);
-        return;
-    }
-    is_advertising = true;
-    LOG_INF("Advertising started");
-    k_work_schedule(&adv_stop_work, K_MINUTES(2));
-}
+static int connections; /* written only from the BT connection callbacks */
 
 static void on_connected(struct bt_conn *conn, uint8_t err)
 {
@@ -111,9 +68,8 @@ static void on_connected(struct bt_conn *conn, uint8_t err)
         LOG_ERR("Connection failed (err %u)", err);
         return;
     }
-    is_connected = true;
-    is_advertising = false;
-    k_work_cancel_delayable(&adv_stop_work);
+    connections++;
+    adv_on_connected();
     led_blt_set(true);
     LOG_INF("Connected");
 }
@@ -121,16 +77,14 @@ static void on_connected(struct bt_conn *conn, uint8_t err)
 static void on_disconnected(struct bt_conn *conn, uint8_t reason)
 {
     LOG_INF("Disconnected (reason %u)", reason);
-    is_connected = false;
-    if (!is_advertising)
-    {
-        advertising_start(); /* restart for another 2 minutes */
-    }
+    connections--;
+    adv_on_disconnected();
 }
 
 static void recycled_cb(void)
 {
-    // Now device needs to restart for advertising again
+    /* Connection object is free again, so advertising can restart */
+    adv_wake();
 }
 
 static struct bt_conn_cb connection_callbacks = {
@@ -139,11 +93,6 @@ static struct bt_conn_cb connection_callbacks = {
     .recycled = recycled_cb,
 };
 
-static void advertising_start(void)
-{
-    k_work_submit(&adv_work);
-}
-
 static void motor_action(uint8_t intensity, const struct tm *when)
 {
     (void)when;
@@ -155,6 +104,13 @@ static void rtc_alarm_cb(void *user)
 {
     (void)user;
     (void)schedule_queue_on_alarm(motor_action);
+    adv_status_changed();
+}
+
+static void on_spray_state(void)
+{
+    ble_cycle_state_notify();
+    adv_status_changed();
 }
 
 int main(void)
@@ -175,8 +131,8 @@ int main(void)
     mcp7940n_set_alarm_callback(&rtc, rtc_alarm_cb, NULL);
     at24c32_init();
     stats_init_if_blank();
+    rollups_init();
     sched_init_if_blank();
-    schedule_queue_init_if_blank();
     seed_time_from_build_if_needed();
 
     (void)schedule_queue_sync_and_arm_next();
@@ -193,6 +149,7 @@ int main(void)
     if (spray_init() != 0)
         LOG_ERR("spray_init failed");
     spray_callback();
+    spray_set_state_callback(on_spray_state);
 
     err = bt_enable(NULL);
     if (err)
@@ -203,13 +160,20 @@ int main(void)
     bt_conn_cb_register(&connection_callbacks);
     LOG_INF("Bluetooth initialized");
 
-    k_work_init(&adv_work, adv_work_handler);
-    k_work_init_delayable(&adv_stop_work, adv_stop_work_handler);
-    advertising_start();
+    /* Bonds, CCC state and the GATT hash (settings_ee.h) */
+    err = settings_load();
+    if (err)
+    {
+        LOG_ERR("settings_load err %d", err);
+    }
+
+    bulk_init();
+
+    adv_start();
 
     while (1)
     {
-        if (is_connected)
+        if (connections > 0)
         {
             led_blt_set(true);
             // k_sleep(K_MSEC(500));
@@ -219,7 +183,7 @@ int main(void)
             mcp7940n_get_time(&rtc, &t);
             LOG_INF("RTC: %s", tm_to_str(&t, tsbuf, sizeof(tsbuf)));
         }
-        else if (is_advertising)
+        else if (adv_is_active())
         {
 
             led_blt_toggle();
@@ -0,0 +1,218 @@
+#include "rollups.h"
+#include "stats.h"
+#include "slider.h"
+#include "at24c32.h"
+#include "tm_helpers.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include <errno.h>
+
+LOG_MODULE_REGISTER(rollups, LOG_LEVEL_INF);
+
+BUILD_ASSERT(ROLLUP_BASE >= STATS_BASE + STATS_TOTAL_LEN, "rollups overlap the statistics log");
+BUILD_ASSERT(ROLLUP_BASE + ROLLUP_CKPT_LEN <= AT24C32_SIZE, "rollups past end of EEPROM");
+
+#define DAY_NONE 0xFFFFu
+#define BACKFILL_BATCH 16u
+
+/* Counted in RAM; GATT reads are served from here. The EEPROM only sees
+ * the checkpoint, at most once per ROLLUP_CKPT_MS.
+ */
+static uint8_t s_img[ROLLUP_TOTAL_LEN];
+static K_MUTEX_DEFINE(s_lock);
+
+static void ckpt_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(ckpt_work, ckpt_work_handler);
+
+/* Planned spray time of one event, from the same table the cycle uses */
+static uint32_t spray_ms_for(uint8_t intensity2b)
+{
+    struct cycle_cfg_t cfg;
+    slider_state_to_cycle_cfg((int)(intensity2b & 0x03u), &cfg);
+    return (uint32_t)cfg.spray_ms * (cfg.repeats ? cfg.repeats : 1u);
+}
+
+static inline void put16(uint16_t off, uint16_t v)
+{
+    sys_put_le16(v, &s_img[off]);
+}
+
+static inline void put32(uint16_t off, uint32_t v)
+{
+    sys_put_le32(v, &s_img[off]);
+}
+
+static uint16_t sat_inc16(uint16_t v)
+{
+    return (v == UINT16_MAX) ? v : (uint16_t)(v + 1u);
+}
+
+/* Fold one event into the image */
+static void count_event(const struct tm *t, uint8_t intensity2b)
+{
+    const uint32_t epoch = tm_to_epoch(t);
+    const uint16_t day = (uint16_t)(epoch / 86400u);
+    const uint16_t how = (uint16_t)(((day + 6u) % 7u) * 24u + (uint32_t)t->tm_hour); /* 2000-01-01 was a Saturday */
+    uint16_t last = sys_get_le16(&s_img[4]);
+
+    if (last == DAY_NONE || day > last)
+    {
+        // Moving to a newer day recycles the slots of the days it skips over
+        const uint32_t gap = (last == DAY_NONE) ? ROLLUP_DAYS : MIN((uint32_t)(day - last), ROLLUP_DAYS);
+        for (uint32_t k = 0; k < gap; k++)
+        {
+            put16(ROLLUP_DAYS_OFF + ((day - k) % ROLLUP_DAYS) * 2u, 0);
+        }
+        put16(4, day);
+        last = day;
+    }
+
+    if ((uint16_t)(last - day) < ROLLUP_DAYS)
+    {
+        const uint16_t off = ROLLUP_DAYS_OFF + (day % ROLLUP_DAYS) * 2u;
+        put16(off, sat_inc16(sys_get_le16(&s_img[off])));
+    }
+
+    const uint16_t ms_off = ROLLUP_MS_OFF + (intensity2b & 0x03u) * 4u;
+    put32(ms_off, sys_get_le32(&s_img[ms_off]) + spray_ms_for(intensity2b));
+
+    if (how < ROLLUP_HOW_BUCKETS)
+    {
+        const uint16_t off = ROLLUP_HOW_OFF + how * 2u;
+        put16(off, sat_inc16(sys_get_le16(&s_img[off])));
+    }
+}
+
+/* Count logged events from seq up to the head; returns how many */
+static uint32_t replay(uint32_t seq)
+{
+    uint32_t first, head;
+    stats_bounds(&first, &head);
+    if (seq - first > head - first)
+        seq = first; /* overwritten or cleared since; count what is left */
+
+    const uint32_t from = seq;
+    while (seq != head)
+    {
+        struct stats_entry batch[BACKFILL_BATCH];
+        const uint8_t n = stats_get_range(seq, BACKFILL_BATCH, batch);
+        if (n == 0)
+        {
+            break;
+        }
+        for (uint8_t i = 0; i < n; i++)
+        {
+            struct tm t;
+            tm_from_7(&t, batch[i].time);
+            count_event(&t, batch[i].int2b);
+        }
+        seq += n;
+    }
+    return seq - from;
+}
+
+/* Write the image with the stats sequence number it counts up to. Runs on
+ * the storage thread, which is also where sprays are logged and counted,
+ * so every event below stats_head_seq() is already in the image.
+ */
+static void ckpt_work_handler(struct k_work *work)
+{
+    uint8_t tr[ROLLUP_CKPT_TRAILER_LEN];
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    sys_put_le32(stats_head_seq(), tr);
+    tr[4] = crc8_ccitt(crc8_ccitt(0xFF, s_img, sizeof(s_img)), tr, 4);
+    int rc = at24c32_write_bytes(ROLLUP_BASE, s_img, sizeof(s_img));
+    k_mutex_unlock(&s_lock);
+
+    if (rc == 0)
+    {
+        rc = at24c32_write_bytes(ROLLUP_BASE + ROLLUP_TOTAL_LEN, tr, sizeof(tr));
+    }
+    if (rc)
+    {
+        LOG_ERR("rollups: checkpoint failed (%d)", rc);
+    }
+}
+
+static void reset_image(void)
+{
+    memset(s_img, 0, sizeof(s_img));
+    s_img[0] = 'R';
+    s_img[1] = 'U';
+    s_img[2] = ROLLUP_VERSION;
+    s_img[3] = 0xFF;
+    sys_put_le16(DAY_NONE, &s_img[4]);
+    sys_put_le16(0xFFFFu, &s_img[6]);
+}
+
+void rollups_init(void)
+{
+    uint8_t tr[ROLLUP_CKPT_TRAILER_LEN];
+    uint32_t seq;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+
+    int rc = at24c32_read_bytes(ROLLUP_BASE, s_img, sizeof(s_img));
+    if (rc == 0)
+    {
+        rc = at24c32_read_bytes(ROLLUP_BASE + ROLLUP_TOTAL_LEN, tr, sizeof(tr));
+    }
+    if (rc)
+    {
+        LOG_ERR("rollups: read failed (%d)", rc);
+    }
+
+    const bool valid = (rc == 0 && s_img[0] == 'R' && s_img[1] == 'U' &&
+                        s_img[2] == ROLLUP_VERSION &&
+                        crc8_ccitt(crc8_ccitt(0xFF, s_img, sizeof(s_img)), tr, 4) == tr[4]);
+    if (valid)
+    {
+        seq = sys_get_le32(tr);
+    }
+    else
+    {
+        LOG_WRN("rollups: no valid checkpoint, rebuilding from the statistics log");
+        reset_image();
+        seq = stats_first_seq();
+    }
+
+    const uint32_t n = replay(seq);
+    k_mutex_unlock(&s_lock);
+
+    LOG_INF("rollups: %s, %u logged events replayed", valid ? "checkpoint loaded" : "rebuilt",
+            (unsigned)n);
+    if (n || !valid)
+    {
+        k_work_schedule_for_queue(at24c32_workq(), &ckpt_work, K_MSEC(ROLLUP_CKPT_MS));
+    }
+}
+
+int rollups_add(const struct tm *t, uint8_t intensity2b)
+{
+    if (!t)
+        return -EINVAL;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    count_event(t, intensity2b);
+    k_mutex_unlock(&s_lock);
+
+    /* Not rescheduled: a steady stream of sprays still checkpoints */
+    k_work_schedule_for_queue(at24c32_workq(), &ckpt_work, K_MSEC(ROLLUP_CKPT_MS));
+    return 0;
+}
+
+size_t rollups_read(size_t offset, uint8_t *out, size_t len)
+{
+    if (!out || offset >= sizeof(s_img))
+        return 0;
+
+    len = MIN(len, sizeof(s_img) - offset);
+    k_mutex_lock(&s_lock, K_FOREVER);
+    memcpy(out, &s_img[offset], len);
+    k_mutex_unlock(&s_lock);
+    return len;
+}
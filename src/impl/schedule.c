@@ -1,140 +1,353 @@
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
 #include <time.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 
 #include "schedule.h"
 #include "tm_helpers.h"
 #include "at24c32.h"
 
-static int rd_count(uint8_t *c)
+LOG_MODULE_REGISTER(schedule, LOG_LEVEL_INF);
+
+BUILD_ASSERT(sizeof(struct sched_rule) == SCHED_RULE_LEN, "rules are read as laid out");
+BUILD_ASSERT(SCHED_CAP <= UINT8_MAX && SCHED_MIN_PER_DAY <= 0x0800u, "item fields");
+BUILD_ASSERT(SCHED_BASE + SCHED_TOTAL_LEN <= 0x0600u, "schedule runs into the statistics log");
+
+/* Older layouts, only read by the conversion. Both held 5 entries. */
+#define OLD_CAP 5u
+#define V2_FORMAT 0xA2u
+#define V2_RULES_OFF (SCHED_BASE + 2u)
+#define V1_TIMES_OFF (SCHED_BASE + 1u)
+#define V1_TIMES_LEN (OLD_CAP * SCHED_TIME_LEN)
+
+/* The table lives in RAM so next-occurrence lookups never touch the bus;
+ * writes go to both. k_mutex is recursive.
+ */
+static K_MUTEX_DEFINE(s_lock);
+static struct sched_table s_tab;
+static uint32_t s_gen; /* see sched_generation() */
+
+bool sched_rule_valid(const struct sched_rule *r)
 {
-    return at24c32_read_bytes(SCHED_COUNT_OFF, c, 1) ? -1 : 0;
+    return r->hour < 24u && r->min < 60u && r->days != 0u &&
+           (r->days & ~SCHED_DAYS_ALL) == 0u && r->int2b <= 3u;
 }
-static int wr_count(uint8_t c)
+
+uint16_t sched_entry_minute(const uint8_t entry[SCHED_ENTRY_LEN])
 {
-    return at24c32_write_bytes(SCHED_COUNT_OFF, &c, 1) ? -1 : 0;
+    struct tm t;
+    tm_from_7(&t, entry);
+    return (uint16_t)(t.tm_hour * 60 + t.tm_min);
 }
 
-static int rd_time_i(uint8_t i, uint8_t *t7)
+bool sched_table_valid(const struct sched_table *t)
 {
-    const uint16_t off = (uint16_t)(SCHED_TIMES_OFF + (uint16_t)i * SCHED_TIME_LEN);
-    return at24c32_read_bytes(off, t7, SCHED_TIME_LEN) ? -1 : 0;
+    if (t->count > SCHED_CAP)
+        return false;
+
+    for (uint8_t s = 0; s < SCHED_DAYSETS; ++s)
+    {
+        if (t->days[s] & ~SCHED_DAYS_ALL)
+            return false;
+    }
+
+    for (uint8_t i = 0; i < t->count; ++i)
+    {
+        const uint16_t it = t->items[i];
+        if (SCHED_ITEM_MIN(it) >= SCHED_MIN_PER_DAY || t->days[SCHED_ITEM_SET(it)] == 0u)
+            return false;
+    }
+    return true;
 }
-static int wr_time_i(uint8_t i, const uint8_t *t7)
+
+int sched_table_add(struct sched_table *t, uint16_t min, uint8_t int2b, uint8_t days)
 {
-    const uint16_t off = (uint16_t)(SCHED_TIMES_OFF + (uint16_t)i * SCHED_TIME_LEN);
-    return at24c32_write_bytes(off, t7, SCHED_TIME_LEN) ? -1 : 0;
+    if (t->count >= SCHED_CAP || min >= SCHED_MIN_PER_DAY || int2b > 3u ||
+        days == 0u || (days & ~SCHED_DAYS_ALL))
+        return -ERANGE;
+
+    uint8_t set = SCHED_DAYSETS;
+    for (uint8_t s = 0; s < SCHED_DAYSETS && set == SCHED_DAYSETS; ++s)
+    {
+        if (t->days[s] == days)
+            set = s;
+    }
+    for (uint8_t s = 0; s < SCHED_DAYSETS && set == SCHED_DAYSETS; ++s)
+    {
+        if (t->days[s] == 0u)
+        {
+            t->days[s] = days;
+            set = s;
+        }
+    }
+    if (set == SCHED_DAYSETS)
+        return -ERANGE;
+
+    t->items[t->count++] = SCHED_ITEM(min, int2b, set);
+    return 0;
 }
 
-static int rd_int_byte(uint8_t idx, uint8_t *b)
+int sched_table_from_image(struct sched_table *t, const uint8_t *img, uint16_t len)
 {
-    return at24c32_read_bytes((uint16_t)(SCHED_INT_OFF + idx), b, 1) ? -1 : 0;
+    if (len < SCHED_HDR_LEN || img[1] != SCHED_FORMAT)
+        return -EMSGSIZE;
+    if (img[0] > SCHED_CAP)
+        return -ERANGE;
+    if (len != SCHED_HDR_LEN + (uint32_t)img[0] * SCHED_ITEM_LEN)
+        return -EMSGSIZE;
+
+    t->count = img[0];
+    memcpy(t->days, &img[2], SCHED_DAYSETS);
+    for (uint8_t i = 0; i < t->count; ++i)
+    {
+        t->items[i] = sys_get_le16(&img[SCHED_HDR_LEN + (uint32_t)i * SCHED_ITEM_LEN]);
+    }
+    return sched_table_valid(t) ? 0 : -ERANGE;
 }
-static int wr_int_byte(uint8_t idx, uint8_t b)
+
+static void to_image(const struct sched_table *t, uint8_t img[SCHED_TOTAL_LEN])
 {
-    return at24c32_write_bytes((uint16_t)(SCHED_INT_OFF + idx), &b, 1) ? -1 : 0;
+    memset(img, 0, SCHED_TOTAL_LEN);
+    img[0] = t->count;
+    img[1] = SCHED_FORMAT;
+    memcpy(&img[2], t->days, SCHED_DAYSETS);
+    for (uint8_t i = 0; i < t->count; ++i)
+    {
+        sys_put_le16(t->items[i], &img[SCHED_HDR_LEN + (uint32_t)i * SCHED_ITEM_LEN]);
+    }
 }
 
-static int get_intensity(uint8_t i, uint8_t *out2b)
+/* Stable, so items at the same minute keep their upload order */
+static void sort_items(struct sched_table *t)
 {
-    uint8_t b, shift = (uint8_t)((i & 3u) * 2u);
-    if (rd_int_byte(i >> 2, &b))
-        return -1;
-    *out2b = (uint8_t)((b >> shift) & 0x3u);
-    return 0;
+    for (uint8_t i = 1; i < t->count; ++i)
+    {
+        const uint16_t it = t->items[i];
+        uint8_t j = i;
+        while (j > 0 && SCHED_ITEM_MIN(t->items[j - 1]) > SCHED_ITEM_MIN(it))
+        {
+            t->items[j] = t->items[j - 1];
+            j--;
+        }
+        t->items[j] = it;
+    }
 }
-static int set_intensity(uint8_t i, uint8_t v)
+
+/* Items of an older layout: v2 rules keep their masks, v1 entries run daily */
+static void convert_old(const uint8_t *img, struct sched_table *t)
 {
-    if (v > 3u)
-        return -2;
-    uint8_t b, idx = i >> 2, shift = (uint8_t)((i & 3u) * 2u);
-    if (rd_int_byte(idx, &b))
-        return -1;
-    b = (uint8_t)((b & (uint8_t)~(0x3u << shift)) | ((v & 0x3u) << shift));
-    return wr_int_byte(idx, b) ? -1 : 0;
+    const uint8_t c = MIN(img[0], OLD_CAP);
+    memset(t, 0, sizeof(*t));
+
+    if (img[1] == V2_FORMAT)
+    {
+        struct sched_rule r[OLD_CAP];
+        memcpy(r, &img[V2_RULES_OFF - SCHED_BASE], sizeof(r));
+        for (uint8_t i = 0; i < c; ++i)
+        {
+            if (sched_rule_valid(&r[i]))
+                (void)sched_table_add(t, (uint16_t)(r[i].hour * 60u + r[i].min), r[i].int2b, r[i].days);
+        }
+    }
+    else
+    {
+        const uint8_t *times = &img[V1_TIMES_OFF - SCHED_BASE];
+        for (uint8_t i = 0; i < c; ++i)
+        {
+            struct tm tm;
+            tm_from_7(&tm, &times[(uint32_t)i * SCHED_TIME_LEN]);
+            if (tm.tm_hour >= 24 || tm.tm_min >= 60)
+                continue;
+            const uint8_t inten = (uint8_t)(times[V1_TIMES_LEN + (i >> 2)] >> ((i & 3u) * 2u)) & 0x03u;
+            (void)sched_table_add(t, sched_entry_minute(&times[(uint32_t)i * SCHED_TIME_LEN]), inten,
+                                  SCHED_DAYS_ALL);
+        }
+    }
+    sort_items(t);
+
+    LOG_INF("schedule: converted %u of %u entries from format 0x%02x", t->count, c, img[1]);
 }
 
 void sched_init_if_blank(void)
 {
-    uint8_t c;
-    if (rd_count(&c))
+    uint8_t img[SCHED_TOTAL_LEN];
+    struct sched_table t = {0};
+
+    if (at24c32_read_bytes(SCHED_BASE, img, sizeof(img)))
+    {
+        LOG_ERR("schedule: area unreadable");
         return;
-    if (c == 0xFFu)
-    {
-        (void)wr_count(0u);
-        for (uint8_t i = 0; i < SCHED_INT_LEN; ++i)
-            (void)wr_int_byte(i, 0u);
-        uint8_t z[SCHED_TIME_LEN] = {0};
-        for (uint8_t i = 0; i < SCHED_CAP; ++i)
-            (void)wr_time_i(i, z);
-    }
-}
-
-int sched_append(const uint8_t time7[SCHED_TIME_LEN], uint8_t intensity2b)
-{
-    uint8_t c;
-    if (rd_count(&c))
-        return -3;
-    if (c >= SCHED_CAP)
-        return -1;
-    if (intensity2b > 3u)
-        return -2;
-    if (wr_time_i(c, time7))
-        return -3;
-    if (set_intensity(c, intensity2b))
-        return -3;
-    if (wr_count((uint8_t)(c + 1u)))
-        return -3;
-    return (int)c;
-}
-
-int sched_get(uint8_t index, uint8_t out_time7[SCHED_TIME_LEN], uint8_t *out_int2b)
-{
-    uint8_t c;
-    if (rd_count(&c))
-        return -3;
-    if (index >= c)
-        return -1;
-    if (rd_time_i(index, out_time7))
-        return -3;
-    if (out_int2b && get_intensity(index, out_int2b))
-        return -3;
-    return 0;
+    }
+
+    bool rewrite = false;
+    if (img[0] == 0xFFu)
+    {
+        rewrite = true;
+    }
+    else if (img[1] != SCHED_FORMAT)
+    {
+        convert_old(img, &t);
+        rewrite = true;
+    }
+    else if (sched_table_from_image(&t, img, (uint16_t)(SCHED_HDR_LEN + MIN(img[0], SCHED_CAP) *
+                                                                            SCHED_ITEM_LEN)) != 0)
+    {
+        LOG_WRN("schedule: stored image invalid, cleared");
+        memset(&t, 0, sizeof(t));
+        rewrite = true;
+    }
+
+    if (rewrite)
+    {
+        to_image(&t, img);
+        if (at24c32_write_bytes(SCHED_BASE, img, sizeof(img)))
+            LOG_ERR("schedule: format write failed");
+    }
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    s_tab = t;
+    s_gen++;
+    k_mutex_unlock(&s_lock);
+}
+
+int sched_get(uint8_t index, uint16_t *item)
+{
+    int rc = -1;
+    k_mutex_lock(&s_lock, K_FOREVER);
+    if (index < s_tab.count)
+    {
+        if (item)
+            *item = s_tab.items[index];
+        rc = 0;
+    }
+    k_mutex_unlock(&s_lock);
+    return rc;
+}
+
+uint8_t sched_days(uint8_t set)
+{
+    if (set >= SCHED_DAYSETS)
+        return 0u;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint8_t days = s_tab.days[set];
+    k_mutex_unlock(&s_lock);
+    return days;
 }
 
 uint8_t sched_count(void)
 {
-    uint8_t c = 0;
-    if (rd_count(&c))
-        return 0;
-    if (c == 0xFFu)
-        return 0;
-    if (c > SCHED_CAP)
-        c = SCHED_CAP;
-    return c;
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint8_t n = s_tab.count;
+    k_mutex_unlock(&s_lock);
+    return n;
 }
 
 void sched_clear(void)
 {
-    (void)wr_count(0u);
+    static const struct sched_table empty;
+    (void)sched_set(&empty);
 }
 
-int sched_append_tm(const struct tm *t, uint8_t intensity2b)
+int sched_set(const struct sched_table *t)
 {
-    if (!tm_sane(t) || intensity2b > 3u)
-        return -2;
-    uint8_t b[SCHED_TIME_LEN];
-    tm_to_7(t, b);
-    return sched_append(b, intensity2b);
+    if (!sched_table_valid(t))
+        return -EINVAL;
+
+    struct sched_table sorted = *t;
+    sort_items(&sorted);
+
+    /* Sorting shifts the items after an edit, so diff the whole image */
+    uint8_t old_img[SCHED_TOTAL_LEN];
+    uint8_t new_img[SCHED_TOTAL_LEN];
+    int rc = 0;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    to_image(&s_tab, old_img);
+    to_image(&sorted, new_img);
+
+    uint16_t lo = 0;
+    uint16_t hi = SCHED_TOTAL_LEN;
+    while (lo < hi && old_img[lo] == new_img[lo])
+        lo++;
+    while (hi > lo && old_img[hi - 1u] == new_img[hi - 1u])
+        hi--;
+
+    if (lo < hi)
+    {
+        if (at24c32_write_bytes((uint16_t)(SCHED_BASE + lo), &new_img[lo], hi - lo))
+        {
+            rc = -EIO;
+        }
+        else
+        {
+            s_tab = sorted;
+            s_gen++;
+            rc = hi - lo;
+        }
+    }
+    k_mutex_unlock(&s_lock);
+
+    return rc;
 }
 
-int sched_get_tm(uint8_t index, struct tm *out_t, uint8_t *out_int2b)
+uint32_t sched_generation(void)
 {
-    uint8_t b[SCHED_TIME_LEN];
-    int r = sched_get(index, b, out_int2b);
-    if (r < 0)
-        return r;
-    if (out_t)
-        tm_from_7(out_t, b);
-    return 0;
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint32_t gen = s_gen;
+    k_mutex_unlock(&s_lock);
+    return gen;
+}
+
+/* First index whose minute is after m */
+static uint8_t upper_bound(uint16_t m)
+{
+    uint8_t lo = 0;
+    uint8_t hi = s_tab.count;
+    while (lo < hi)
+    {
+        const uint8_t mid = (uint8_t)((lo + hi) / 2u);
+        if (SCHED_ITEM_MIN(s_tab.items[mid]) <= m)
+            lo = (uint8_t)(mid + 1u);
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int sched_next_fire_after(const struct tm *now, struct tm *when, uint8_t *int2b)
+{
+    /* Weekday from the date, not from whatever the RTC register holds */
+    const uint32_t day = tm_to_epoch(now) / 86400u;
+    const uint8_t wday = (uint8_t)((day + 6u) % 7u); /* 2000-01-01 was a Saturday */
+    const uint16_t now_min = (uint16_t)(now->tm_hour * 60 + now->tm_min);
+
+    int rc = -ENOENT;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    /* d == 7 is today next week, for items at or before now */
+    for (uint32_t d = 0; d <= 7u && rc != 0; ++d)
+    {
+        const uint8_t bit = (uint8_t)(1u << ((wday + d) % 7u));
+
+        for (uint8_t i = (d == 0) ? upper_bound(now_min) : 0; i < s_tab.count; ++i)
+        {
+            const uint16_t it = s_tab.items[i];
+            if (!(s_tab.days[SCHED_ITEM_SET(it)] & bit))
+                continue;
+
+            tm_from_epoch(when, (day + d) * 86400u + SCHED_ITEM_MIN(it) * 60u);
+            if (int2b)
+                *int2b = SCHED_ITEM_INT(it);
+            rc = 0;
+            break;
+        }
+    }
+    k_mutex_unlock(&s_lock);
+
+    return rc;
 }
@@ -1,287 +1,20 @@
 #include <string.h>
+#include <stdbool.h>
 #include "schedule_queue.h"
 #include "schedule.h"
-#include "at24c32.h"
 #include "tm_helpers.h"
 #include "mcp7940n.h"
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_REGISTER(schedule_queue, LOG_LEVEL_INF);
 
-static void bytes_to_hex_7(const uint8_t in[7], char out[3 * 7 + 1])
-{
-    /* out must be at least 22 bytes ("XX XX XX XX XX XX XX\0") */
-    static const char *hex = "0123456789ABCDEF";
-    for (int i = 0; i < 7; i++)
-    {
-        out[i * 3 + 0] = hex[(in[i] >> 4) & 0xF];
-        out[i * 3 + 1] = hex[in[i] & 0xF];
-        out[i * 3 + 2] = (i == 6) ? '\0' : ' ';
-    }
-}
-
-void schedule_queue_log(void)
-{
-    uint8_t count = schedule_queue_count();
-
-    if (count == 0xFF)
-    {
-        LOG_INF("schedule: queue appears uninitialized");
-        return;
-    }
-    if (count == 0)
-    {
-        LOG_INF("schedule: queue is empty");
-        return;
-    }
-
-    LOG_INF("schedule: queue has %u entr%s", count, (count == 1) ? "y" : "ies");
-
-    for (uint8_t i = 0; i < count; i++)
-    {
-        uint8_t time7[SCHEDULE_QUEUE_TIME_LEN];
-        uint8_t intensity = 0;
-        int rc = schedule_queue_pop(time7, &intensity);
-        if (rc != 0)
-        {
-            LOG_INF("schedule: failed to read entry %u (rc=%d)", i, rc);
-            return;
-        }
-
-        char hexbuf[3 * SCHEDULE_QUEUE_TIME_LEN + 1];
-        bytes_to_hex_7(time7, hexbuf);
+/* Callers: boot, the RTC alarm work and BLE commits on the storage queue */
+static K_MUTEX_DEFINE(s_lock);
 
-        LOG_INF("  [%u] time7=%s intensity=%u", i, hexbuf, intensity);
-
-        rc = schedule_queue_push(time7, intensity);
-        if (rc != 0)
-        {
-            LOG_INF("schedule: ERROR restoring entry %u (rc=%d); queue order may be altered", i, rc);
-            return;
-        }
-    }
-
-    LOG_INF("schedule: done listing %u entr%s", count, (count == 1) ? "y" : "ies");
-}
-
-/* ---- AT24 helpers ---- */
-static int rd8(uint16_t addr, uint8_t *v) { return at24c32_read_byte(addr, v); }
-static int wr8(uint16_t addr, uint8_t v) { return at24c32_write_byte(addr, v); }
-static int rdb(uint16_t a, void *buf, size_t len) { return at24c32_read_bytes(a, (uint8_t *)buf, len); }
-static int wrb(uint16_t a, const void *buf, size_t len) { return at24c32_write_bytes(a, (const uint8_t *)buf, len); }
-
-/* Entry i address (linear) */
-static inline uint16_t entry_addr(uint8_t i)
-{
-    return (uint16_t)(SCHEDULE_QUEUE_ENTRIES_OFF + ((uint16_t)i * SCHEDULE_QUEUE_ENTRY_SIZE));
-}
-
-/* Read/write one entry */
-static int read_entry(uint8_t i, uint8_t time7[7], uint8_t *int2b)
-{
-    if (!time7)
-        return -1;
-    const uint16_t a = entry_addr(i);
-    uint8_t inten = 0;
-    if (rdb(a, time7, 7) != 0)
-        return -1;
-    if (rd8((uint16_t)(a + 7u), &inten) != 0)
-        return -1;
-    if (int2b)
-        *int2b = (uint8_t)(inten & 0x03u);
-    return 0;
-}
-static int write_entry(uint8_t i, const uint8_t time7[7], uint8_t int2b)
-{
-    if (!time7)
-        return -1;
-    const uint16_t a = entry_addr(i);
-    const uint8_t inten = (uint8_t)(int2b & 0x03u);
-    if (wrb(a, time7, 7) != 0)
-        return -1;
-    if (wr8((uint16_t)(a + 7u), inten) != 0)
-        return -1;
-    return 0;
-}
-
-/* Compare two struct tm chronologically */
-
-/* ---- Public API ---- */
-
-void schedule_queue_init_if_blank(void)
-{
-    uint8_t cnt;
-    if (rd8(SCHEDULE_QUEUE_COUNT_OFF, &cnt) != 0)
-    {
-        /* If read fails, force-init */
-        cnt = 0xFFu;
-    }
-    if (cnt == 0xFFu)
-    {
-        (void)wr8(SCHEDULE_QUEUE_COUNT_OFF, 0u);
-
-        /* Optional: clear entries region (<= 40 bytes total) */
-        uint8_t zeros[AT24C32_PAGE_SIZE] = {0};
-        const size_t total = (size_t)SCHEDULE_QUEUE_CAP * SCHEDULE_QUEUE_ENTRY_SIZE;
-        size_t off = 0;
-        while (off < total)
-        {
-            const size_t chunk = MIN(sizeof(zeros), total - off);
-            (void)wrb((uint16_t)(SCHEDULE_QUEUE_ENTRIES_OFF + off), zeros, chunk);
-            off += chunk;
-        }
-    }
-}
-
-void schedule_queue_clear(void)
-{
-    (void)wr8(SCHEDULE_QUEUE_COUNT_OFF, 0u);
-}
-
-uint8_t schedule_queue_count(void)
-{
-    uint8_t cnt = 0;
-    if (rd8(SCHEDULE_QUEUE_COUNT_OFF, &cnt) != 0)
-        return 0;
-    if (cnt > SCHEDULE_QUEUE_CAP)
-    { /* sanitize if corrupted */
-        (void)wr8(SCHEDULE_QUEUE_COUNT_OFF, 0u);
-        return 0;
-    }
-    return cnt;
-}
-
-/* Append at end (no wrap). */
-int schedule_queue_push(const uint8_t time7[7], uint8_t intensity2b)
-{
-    if (!time7)
-        return -1;
-
-    uint8_t cnt;
-    if (rd8(SCHEDULE_QUEUE_COUNT_OFF, &cnt) != 0)
-        return -1;
-    if (cnt > SCHEDULE_QUEUE_CAP)
-    { /* sanitize */
-        (void)wr8(SCHEDULE_QUEUE_COUNT_OFF, 0u);
-        return -1;
-    }
-    if (cnt >= SCHEDULE_QUEUE_CAP)
-        return -1; /* full */
-
-    if (write_entry(cnt, time7, (uint8_t)(intensity2b & 0x03u)) != 0)
-        return -1;
-    if (wr8(SCHEDULE_QUEUE_COUNT_OFF, (uint8_t)(cnt + 1u)) != 0)
-        return -1;
-    return 0;
-}
-
-/* Read first entry only */
-int schedule_queue_peek(uint8_t out_time7[7], uint8_t *out_int2b)
-{
-    if (!out_time7)
-        return -1;
-
-    uint8_t cnt;
-    if (rd8(SCHEDULE_QUEUE_COUNT_OFF, &cnt) != 0)
-        return -1;
-    if (cnt == 0u || cnt > SCHEDULE_QUEUE_CAP)
-        return -1;
-
-    return read_entry(0u, out_time7, out_int2b);
-}
-
-/* Pop first entry and shift remaining left by one (max 4 moves => fine). */
-int schedule_queue_pop(uint8_t out_time7[7], uint8_t *out_int2b)
-{
-    uint8_t cnt;
-    if (rd8(SCHEDULE_QUEUE_COUNT_OFF, &cnt) != 0)
-        return -1;
-    if (cnt == 0u || cnt > SCHEDULE_QUEUE_CAP)
-        return -1;
-
-    /* optionally return the popped data */
-    if (out_time7 || out_int2b)
-    {
-        if (read_entry(0u, out_time7 ? out_time7 : (uint8_t[7]){0}, out_int2b) != 0)
-            return -1;
-    }
-
-    /* Compact if there are remaining entries */
-    if (cnt > 1u)
-    {
-        /* Move bytes [entry 1 .. entry cnt-1] -> [entry 0 .. entry cnt-2] */
-        const size_t move_bytes = (size_t)(cnt - 1u) * SCHEDULE_QUEUE_ENTRY_SIZE;
-        uint8_t buf[(SCHEDULE_QUEUE_CAP - 1u) * SCHEDULE_QUEUE_ENTRY_SIZE];
-
-        if (rdb(entry_addr(1u), buf, move_bytes) != 0)
-            return -1;
-        if (wrb(entry_addr(0u), buf, move_bytes) != 0)
-            return -1;
-    }
-
-    /* Decrement count */
-    if (wr8(SCHEDULE_QUEUE_COUNT_OFF, (uint8_t)(cnt - 1u)) != 0)
-        return -1;
-    return 0;
-}
-
-/* Build a sorted (by time) linear list starting at index 0 */
-int schedule_queue_rebuild_from_sched(void)
-{
-    struct item
-    {
-        struct tm t;
-        uint8_t time7[7];
-        uint8_t inten2b;
-    } items[SCHEDULE_QUEUE_CAP];
-
-    uint8_t n = 0;
-    const uint8_t n_sched = sched_count();
-
-    for (uint8_t i = 0; i < n_sched && n < SCHEDULE_QUEUE_CAP; ++i)
-    {
-        struct tm tmv;
-        uint8_t inten = 0;
-        uint8_t t7[7];
-
-        if (sched_get(i, t7, &inten) != 0)
-            continue;
-        if (sched_get_tm(i, &tmv, &inten) != 0)
-            continue;
-
-        memcpy(items[n].time7, t7, 7);
-        items[n].inten2b = (uint8_t)(inten & 0x03u);
-        items[n].t = tmv;
-        ++n;
-    }
-
-    /* insertion sort by time asc */
-    for (uint8_t i = 1; i < n; ++i)
-    {
-        struct item key = items[i];
-        int j = (int)i - 1;
-        while (j >= 0 && tm_cmp(&items[j].t, &key.t) > 0)
-        {
-            items[j + 1] = items[j];
-            --j;
-        }
-        items[j + 1] = key;
-    }
-
-    /* Write contiguous entries starting at 0, set count=n */
-    if (wr8(SCHEDULE_QUEUE_COUNT_OFF, 0u) != 0)
-        return -1; /* reset first */
-
-    for (uint8_t i = 0; i < n; ++i)
-    {
-        if (write_entry(i, items[i].time7, items[i].inten2b) != 0)
-            return -1;
-    }
-    if (wr8(SCHEDULE_QUEUE_COUNT_OFF, n) != 0)
-        return -1;
-
-    return n;
-}
+static bool s_armed;
+static struct tm s_when;
+static uint8_t s_int2b;
 
 static inline struct mcp7940n *rtc(void) { return mcp7940n_get(); }
 
@@ -291,7 +24,7 @@ static int rtc_now(struct tm *out)
     return (r && out) ? mcp7940n_get_time(r, out) : -1;
 }
 
-static int rtc_alarm_arm_hm(const struct tm *t)
+static int rtc_alarm_arm(const struct tm *t)
 {
     struct mcp7940n *r = rtc();
     if (!r || !t)
@@ -302,49 +35,26 @@ static int rtc_alarm_arm_hm(const struct tm *t)
     return mcp7940n_set_alarm_tm(r, t);
 }
 
-static int rebuild_and_fetch_sane_head(struct tm *head)
+void schedule_queue_log(void)
 {
-    LOG_INF("SC rebuild");
-    int n = schedule_queue_rebuild_from_sched();
-    if (n < 0)
-        return -2;
-    if (n == 0)
-        return 1; // still nothing
+    char tsbuf[100];
 
-    for (;;)
+    k_mutex_lock(&s_lock, K_FOREVER);
+    if (s_armed)
     {
-        uint8_t t7[7];
-        uint8_t dummy_inten; // not used
-        if (schedule_queue_peek(t7, &dummy_inten) != 0)
-            return -2;
-
-        tm_from_7(head, t7);
-        if (tm_sane(head))
-            return 0;
-
-        (void)schedule_queue_pop(NULL, NULL); // drop insane and try next
-        if (schedule_queue_count() == 0)
-            return 1;
+        LOG_INF("schedule: next %s intensity=%u",
+                tm_to_str(&s_when, tsbuf, sizeof(tsbuf)), s_int2b);
+    }
+    else
+    {
+        LOG_INF("schedule: nothing armed");
     }
+    k_mutex_unlock(&s_lock);
 }
 
-// Returns: 0 = got sane head, 1 = queue became empty, -2 = error
-static int peek_drop_insane_until_sane(struct tm *head)
+bool schedule_queue_armed(void)
 {
-    while (schedule_queue_count() > 0)
-    {
-        uint8_t t7[7];
-        uint8_t dummy_inten; // not used
-        if (schedule_queue_peek(t7, &dummy_inten) != 0)
-            return -2;
-
-        tm_from_7(head, t7);
-        if (tm_sane(head))
-            return 0;
-
-        (void)schedule_queue_pop(NULL, NULL);
-    }
-    return 1;
+    return s_armed;
 }
 
 int schedule_queue_sync_and_arm_next(void)
@@ -356,68 +66,24 @@ int schedule_queue_sync_and_arm_next(void)
     }
 
     char tsbuf[100];
+    int rc;
 
-    /* If queue is empty, rebuild ONCE from sched_* */
-    uint8_t cnt = schedule_queue_count();
-    if (cnt == 0u)
+    k_mutex_lock(&s_lock, K_FOREVER);
+    s_armed = false;
+    if (sched_next_fire_after(&now, &s_when, &s_int2b) != 0)
     {
-        LOG_INF("SC rebuild");
-        int n = schedule_queue_rebuild_from_sched();
-        if (n < 0)
-        {
-            return -2; /* EEPROM/queue error */
-        }
-        if (n == 0)
-        {
-            return 1; /* nothing in sched_* either */
-        }
+        rc = 1; /* no rules */
     }
-
-    struct tm head = {0};
-    int rc = peek_drop_insane_until_sane(&head);
-    if (rc == 1)
-    {
-        /* queue became empty while dropping insane */
-        return 1;
-    }
-    if (rc < 0)
-    {
-        /* -2 = error */
-        return rc;
-    }
-
-    /* Drop ALL stale entries (<= now). */
-    for (;;)
+    else
     {
         LOG_INF("RTC now : %s", tm_to_str(&now, tsbuf, sizeof tsbuf));
-        LOG_INF("RTC head: %s", tm_to_str(&head, tsbuf, sizeof tsbuf));
-
-        if (tm_cmp(&head, &now) > 0)
-        {
-            /* head is in the FUTURE → arm and done */
-            return (rtc_alarm_arm_hm(&head) == 0) ? 0 : -3;
-        }
-
-        /* head <= now → stale, drop it */
-        (void)schedule_queue_pop(NULL, NULL);
+        LOG_INF("RTC next: %s", tm_to_str(&s_when, tsbuf, sizeof tsbuf));
 
-        if (schedule_queue_count() == 0u)
-        {
-            /* no more entries to arm */
-            return 1;
-        }
-
-        /* Get next sane head and loop */
-        rc = peek_drop_insane_until_sane(&head);
-        if (rc == 1)
-        {
-            return 1; /* emptied */
-        }
-        if (rc < 0)
-        {
-            return rc; /* error */
-        }
+        rc = (rtc_alarm_arm(&s_when) == 0) ? 0 : -3;
+        s_armed = (rc == 0);
     }
+    k_mutex_unlock(&s_lock);
+    return rc;
 }
 
 int schedule_queue_on_alarm(void (*do_action)(uint8_t intensity, const struct tm *when))
@@ -429,17 +95,17 @@ int schedule_queue_on_alarm(void (*do_action)(uint8_t intensity, const struct tm
         (void)mcp7940n_alarm_clear_flag(r);
     }
 
-    uint8_t t7[7], inten = 0;
-    if (schedule_queue_peek(t7, &inten) == 0)
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const bool fired = s_armed;
+    const struct tm when = s_when;
+    const uint8_t inten = s_int2b;
+    s_armed = false;
+    k_mutex_unlock(&s_lock);
+
+    if (fired && do_action)
     {
-        struct tm when = {0};
-        tm_from_7(&when, t7);
-        if (tm_sane(&when) && do_action)
-        {
-            do_action((uint8_t)(inten & 0x03u), &when);
-        }
-        (void)schedule_queue_pop(NULL, NULL);
+        do_action(inten, &when);
     }
 
     return schedule_queue_sync_and_arm_next();
-}
\ No newline at end of file
+}
@@ -0,0 +1,497 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include "settings_ee.h"
+#include "at24c32.h"
+#include "schedule.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(settings_ee, LOG_LEVEL_INF);
+
+/* All entry points are called with the settings subsystem lock held, so the
+ * log state below needs no locking of its own.
+ */
+
+#define END_MARK 0xFFu
+#define CHUNK 32u
+
+BUILD_ASSERT(SETTINGS_EE_JRNL_BASE >= SCHED_BASE + SCHED_TOTAL_LEN &&
+                 SETTINGS_EE_JRNL_BASE + SETTINGS_EE_JRNL_LEN <= STATS_BASE,
+             "compaction journal must sit in the gap between schedule and stats");
+BUILD_ASSERT(CHUNK == SETTINGS_EE_JRNL_DATA, "one journal slot per copied chunk");
+
+struct rec
+{
+    uint16_t off; /* relative to SETTINGS_EE_BASE */
+    uint8_t name_len;
+    uint16_t val_len;
+};
+
+static uint16_t s_end; /* first free byte (holds END_MARK unless the log is full) */
+
+static inline uint16_t rec_len(const struct rec *r)
+{
+    return (uint16_t)(SETTINGS_EE_REC_HDR_LEN + r->name_len + r->val_len);
+}
+
+static int ee_read(uint16_t off, void *buf, size_t len)
+{
+    return at24c32_read_bytes((uint16_t)(SETTINGS_EE_BASE + off), buf, len) ? -EIO : 0;
+}
+
+static int ee_write(uint16_t off, const void *buf, size_t len)
+{
+    return at24c32_write_bytes((uint16_t)(SETTINGS_EE_BASE + off), buf, len) ? -EIO : 0;
+}
+
+/* The AT24C32 driver caches writes; program them before the next step of
+ * anything whose ordering matters for recovery.
+ */
+static int ee_barrier(void)
+{
+    return at24c32_flush() ? -EIO : 0;
+}
+
+static int ee_mark_end(uint16_t off)
+{
+    const uint8_t m = END_MARK;
+    return (off < SETTINGS_EE_LEN) ? ee_write(off, &m, 1) : 0;
+}
+
+/* 0 = valid record, -ENOENT = end of log, -EBADMSG = torn/corrupt */
+static int rec_read(uint16_t off, struct rec *r)
+{
+    uint8_t h[SETTINGS_EE_REC_HDR_LEN];
+
+    if (off + SETTINGS_EE_REC_HDR_LEN > SETTINGS_EE_LEN)
+        return -ENOENT;
+    if (ee_read(off, h, 1))
+        return -EIO;
+    if (h[0] == END_MARK)
+        return -ENOENT;
+    if (ee_read(off, h, sizeof(h)))
+        return -EIO;
+
+    r->off = off;
+    r->name_len = h[0];
+    r->val_len = sys_get_le16(&h[1]);
+    if (r->name_len == 0 || r->name_len > SETTINGS_MAX_NAME_LEN ||
+        (uint32_t)off + rec_len(r) > SETTINGS_EE_LEN)
+        return -EBADMSG;
+
+    uint8_t crc = crc8_ccitt(0xFF, h, 3);
+    uint8_t buf[CHUNK];
+    for (uint16_t done = 0, n = r->name_len + r->val_len; done < n;)
+    {
+        const uint16_t k = MIN(CHUNK, n - done);
+        if (ee_read((uint16_t)(off + SETTINGS_EE_REC_HDR_LEN + done), buf, k))
+            return -EIO;
+        crc = crc8_ccitt(crc, buf, k);
+        done += k;
+    }
+    return (crc == h[3]) ? 0 : -EBADMSG;
+}
+
+static int rec_name_eq(const struct rec *r, const char *name, size_t name_len)
+{
+    char buf[SETTINGS_MAX_NAME_LEN];
+    if (r->name_len != name_len)
+        return 0;
+    if (ee_read((uint16_t)(r->off + SETTINGS_EE_REC_HDR_LEN), buf, name_len))
+        return 0;
+    return memcmp(buf, name, name_len) == 0;
+}
+
+/* Newest record for name at or after off; 0 if found, -ENOENT if none */
+static int find_latest(uint16_t off, const char *name, size_t name_len, struct rec *out)
+{
+    struct rec r;
+    int found = -ENOENT;
+
+    while (off < s_end && rec_read(off, &r) == 0)
+    {
+        if (rec_name_eq(&r, name, name_len))
+        {
+            *out = r;
+            found = 0;
+        }
+        off = (uint16_t)(off + rec_len(&r));
+    }
+    return found;
+}
+
+static bool rec_is_live(const struct rec *r)
+{
+    char name[SETTINGS_MAX_NAME_LEN];
+    struct rec last;
+
+    if (r->val_len == 0)
+        return false;
+    if (ee_read((uint16_t)(r->off + SETTINGS_EE_REC_HDR_LEN), name, r->name_len))
+        return false;
+    if (find_latest((uint16_t)(r->off + rec_len(r)), name, r->name_len, &last) == 0)
+        return false; /* superseded */
+    return true;
+}
+
+/* ===== compaction =====
+ *
+ * Live records slide down over dead ones, one chunk at a time. Each chunk
+ * is first written with the copy's progress to the journal (two slots, used
+ * alternately, newest valid one wins), then to its destination. After a
+ * reset the newest journal entry is replayed and the copy resumes from
+ * there, so the log is whole again before anything reads it. The copy's
+ * source, from the current record on, is never overwritten.
+ */
+struct cjob
+{
+    uint8_t seq;
+    uint16_t rd;   /* current record, at its old place */
+    uint16_t wr;   /* and its new one */
+    uint16_t len;  /* its length; 0 = look for the next live record */
+    uint16_t done; /* bytes of it copied */
+    uint16_t end;  /* end of the log when compaction started */
+};
+
+static inline uint16_t jrnl_slot(uint8_t seq)
+{
+    return (uint16_t)(SETTINGS_EE_JRNL_BASE + (seq & 1u) * SETTINGS_EE_JRNL_SLOT_LEN);
+}
+
+static int jrnl_put(const struct cjob *c, const uint8_t *data, uint8_t k)
+{
+    uint8_t j[SETTINGS_EE_JRNL_SLOT_LEN];
+    memset(j, 0xFF, sizeof(j));
+    j[0] = SETTINGS_EE_JRNL_MAGIC;
+    j[1] = c->seq;
+    sys_put_le16(c->rd, &j[2]);
+    sys_put_le16(c->wr, &j[4]);
+    sys_put_le16(c->len, &j[6]);
+    sys_put_le16(c->done, &j[8]);
+    sys_put_le16(c->end, &j[10]);
+    j[12] = k;
+    memcpy(&j[13], data, k);
+    j[sizeof(j) - 1] = crc8_ccitt(0xFF, j, sizeof(j) - 1);
+
+    if (at24c32_write_bytes(jrnl_slot(c->seq), j, sizeof(j)))
+        return -EIO;
+    return ee_barrier();
+}
+
+/* Newest valid slot; -ENOENT when no compaction was under way */
+static int jrnl_get(struct cjob *c, uint8_t data[CHUNK], uint8_t *k)
+{
+    uint8_t j[2][SETTINGS_EE_JRNL_SLOT_LEN];
+    int best = -1;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (at24c32_read_bytes(jrnl_slot((uint8_t)i), j[i], sizeof(j[i])))
+            return -EIO;
+        const uint8_t *e = j[i];
+        if (e[0] != SETTINGS_EE_JRNL_MAGIC || (e[1] & 1u) != (uint8_t)i || e[12] > CHUNK ||
+            crc8_ccitt(0xFF, e, sizeof(j[i]) - 1) != e[sizeof(j[i]) - 1])
+            continue;
+        if (best < 0 || (int8_t)(e[1] - j[best][1]) > 0)
+            best = i;
+    }
+    if (best < 0)
+        return -ENOENT;
+
+    const uint8_t *e = j[best];
+    c->seq = e[1];
+    c->rd = sys_get_le16(&e[2]);
+    c->wr = sys_get_le16(&e[4]);
+    c->len = sys_get_le16(&e[6]);
+    c->done = sys_get_le16(&e[8]);
+    c->end = sys_get_le16(&e[10]);
+    *k = e[12];
+    memcpy(data, &e[13], *k);
+
+    if (c->wr > c->rd || c->done + *k > c->len || c->end > SETTINGS_EE_LEN ||
+        (uint32_t)c->rd + c->len > c->end)
+        return -EBADMSG;
+    return 0;
+}
+
+/* Wipe both slots: they hold copies of bond keys */
+static int jrnl_clear(void)
+{
+    uint8_t blank[SETTINGS_EE_JRNL_LEN];
+    memset(blank, 0xFF, sizeof(blank));
+    if (at24c32_write_bytes(SETTINGS_EE_JRNL_BASE, blank, sizeof(blank)))
+        return -EIO;
+    return ee_barrier();
+}
+
+static int chunk_put(struct cjob *c, const uint8_t *data, uint8_t k)
+{
+    if (ee_write((uint16_t)(c->wr + c->done), data, k))
+        return -EIO;
+    int rc = ee_barrier();
+    c->done = (uint16_t)(c->done + k);
+    return rc;
+}
+
+static int compact_run(struct cjob *c)
+{
+    s_end = c->end; /* liveness looks ahead to here */
+
+    for (;;)
+    {
+        while (c->done < c->len)
+        {
+            uint8_t buf[CHUNK];
+            const uint8_t k = (uint8_t)MIN(CHUNK, c->len - c->done);
+            if (c->wr == c->rd)
+            {
+                c->done = c->len; /* already in place */
+                break;
+            }
+            c->seq++;
+            if (ee_read((uint16_t)(c->rd + c->done), buf, k) || jrnl_put(c, buf, k) ||
+                chunk_put(c, buf, k))
+                return -EIO;
+        }
+        c->rd = (uint16_t)(c->rd + c->len);
+        c->wr = (uint16_t)(c->wr + c->len);
+        c->len = 0;
+        c->done = 0;
+
+        /* Next live record; dead ones are left behind for wr to cover */
+        struct rec r;
+        while (c->rd < c->end && rec_read(c->rd, &r) == 0)
+        {
+            if (rec_is_live(&r))
+            {
+                c->len = rec_len(&r);
+                break;
+            }
+            c->rd = (uint16_t)(c->rd + rec_len(&r));
+        }
+        if (c->len == 0)
+            break;
+    }
+
+    LOG_INF("settings compacted: %u -> %u bytes", c->end, c->wr);
+    s_end = c->wr;
+    if (ee_mark_end(c->wr) || ee_barrier())
+        return -EIO;
+    return jrnl_clear();
+}
+
+static int compact(void)
+{
+    struct cjob c = {
+        .rd = SETTINGS_EE_HDR_LEN,
+        .wr = SETTINGS_EE_HDR_LEN,
+        .end = s_end,
+    };
+    return compact_run(&c);
+}
+
+/* Finish a compaction cut short by a reset: replay the newest chunk (the
+ * copy is idempotent) and carry on from it.
+ */
+static int compact_recover(void)
+{
+    struct cjob c;
+    uint8_t buf[CHUNK];
+    uint8_t k;
+
+    int rc = jrnl_get(&c, buf, &k);
+    if (rc == -ENOENT)
+        return 0;
+    if (rc == -EBADMSG)
+    {
+        LOG_ERR("settings journal inconsistent; discarding it");
+        return jrnl_clear();
+    }
+    if (rc)
+        return rc;
+
+    LOG_WRN("settings compaction interrupted at 0x%03x; finishing it", c.rd + c.done);
+    if (chunk_put(&c, buf, k))
+        return -EIO;
+    return compact_run(&c);
+}
+
+/* Walk the log to find its end; format it if the header is missing, finish
+ * an interrupted compaction, and cut off a torn tail so the next append
+ * lands right after the last good record.
+ */
+static int scan(void)
+{
+    uint8_t h[SETTINGS_EE_HDR_LEN];
+    if (ee_read(0, h, sizeof(h)))
+        return -EIO;
+
+    if (h[0] != 'S' || h[1] != 'E' || h[2] != SETTINGS_EE_VERSION)
+    {
+        const uint8_t fmt[SETTINGS_EE_HDR_LEN + 1] = {'S', 'E', SETTINGS_EE_VERSION, 0xFF, END_MARK};
+        LOG_INF("formatting settings area");
+        s_end = SETTINGS_EE_HDR_LEN;
+        if (jrnl_clear())
+            return -EIO;
+        return ee_write(0, fmt, sizeof(fmt));
+    }
+
+    int rc = compact_recover();
+    if (rc)
+        return rc;
+
+    struct rec r;
+    uint16_t off = SETTINGS_EE_HDR_LEN;
+    while ((rc = rec_read(off, &r)) == 0)
+    {
+        off = (uint16_t)(off + rec_len(&r));
+    }
+    s_end = off;
+
+    if (rc == -EBADMSG)
+    {
+        LOG_WRN("settings log truncated at 0x%03x", off);
+        return ee_mark_end(off);
+    }
+    return (rc == -ENOENT) ? 0 : rc;
+}
+
+struct read_arg
+{
+    uint16_t off;
+    uint16_t left;
+};
+
+static ssize_t read_cb(void *cb_arg, void *data, size_t len)
+{
+    struct read_arg *ra = cb_arg;
+    const uint16_t k = (uint16_t)MIN(len, ra->left);
+
+    if (ee_read(ra->off, data, k))
+        return -EIO;
+    ra->off = (uint16_t)(ra->off + k);
+    ra->left = (uint16_t)(ra->left - k);
+    return k;
+}
+
+static int ee_load(struct settings_store *cs, const struct settings_load_arg *arg)
+{
+    struct rec r;
+    uint16_t off = SETTINGS_EE_HDR_LEN;
+
+    while (off < s_end && rec_read(off, &r) == 0)
+    {
+        off = (uint16_t)(off + rec_len(&r));
+        if (!rec_is_live(&r))
+            continue;
+
+        char name[SETTINGS_MAX_NAME_LEN + 1];
+        if (ee_read((uint16_t)(r.off + SETTINGS_EE_REC_HDR_LEN), name, r.name_len))
+            return -EIO;
+        name[r.name_len] = '\0';
+
+        struct read_arg ra = {
+            .off = (uint16_t)(r.off + SETTINGS_EE_REC_HDR_LEN + r.name_len),
+            .left = r.val_len,
+        };
+        (void)settings_call_set_handler(name, r.val_len, read_cb, &ra, arg);
+    }
+    return 0;
+}
+
+static bool value_eq(const struct rec *r, const char *value, size_t val_len)
+{
+    uint8_t buf[CHUNK];
+    uint16_t off = (uint16_t)(r->off + SETTINGS_EE_REC_HDR_LEN + r->name_len);
+
+    if (r->val_len != val_len)
+        return false;
+    for (size_t done = 0; done < val_len;)
+    {
+        const size_t k = MIN(CHUNK, val_len - done);
+        if (ee_read((uint16_t)(off + done), buf, k) || memcmp(buf, value + done, k) != 0)
+            return false;
+        done += k;
+    }
+    return true;
+}
+
+static int ee_save(struct settings_store *cs, const char *name,
+                   const char *value, size_t val_len)
+{
+    const size_t name_len = name ? strlen(name) : 0;
+    if (name_len == 0 || name_len > SETTINGS_MAX_NAME_LEN)
+        return -EINVAL;
+    if (!value)
+        val_len = 0;
+
+    /* Skip writes that would not change anything (the BT host re-saves
+     * CCC and hash values on every connection).
+     */
+    struct rec last;
+    const bool have = (find_latest(SETTINGS_EE_HDR_LEN, name, name_len, &last) == 0);
+    if ((have && value_eq(&last, value, val_len)) || (!have && val_len == 0))
+        return 0;
+
+    const uint32_t need = SETTINGS_EE_REC_HDR_LEN + name_len + val_len;
+    if (s_end + need > SETTINGS_EE_LEN)
+    {
+        int rc = compact();
+        if (rc)
+            return rc;
+        if (s_end + need > SETTINGS_EE_LEN)
+        {
+            LOG_ERR("settings full: %s (%u bytes)", name, (unsigned)need);
+            return -ENOSPC;
+        }
+    }
+
+    uint8_t h[SETTINGS_EE_REC_HDR_LEN];
+    h[0] = (uint8_t)name_len;
+    sys_put_le16((uint16_t)val_len, &h[1]);
+    uint8_t crc = crc8_ccitt(0xFF, h, 3);
+    crc = crc8_ccitt(crc, name, name_len);
+    h[3] = crc8_ccitt(crc, value, val_len);
+
+    /* End mark first: until the header lands, the old end still holds */
+    const uint16_t off = s_end;
+    if (ee_mark_end((uint16_t)(off + need)) ||
+        ee_write((uint16_t)(off + SETTINGS_EE_REC_HDR_LEN), name, name_len) ||
+        (val_len && ee_write((uint16_t)(off + SETTINGS_EE_REC_HDR_LEN + name_len), value, val_len)) ||
+        ee_barrier() || ee_write(off, h, sizeof(h)))
+        return -EIO;
+
+    s_end = (uint16_t)(off + need);
+    return 0;
+}
+
+static const struct settings_store_itf ee_itf = {
+    .csi_load = ee_load,
+    .csi_save = ee_save,
+};
+
+static struct settings_store ee_store = {
+    .cs_itf = &ee_itf,
+};
+
+/* Called by settings_subsys_init() (CONFIG_SETTINGS_CUSTOM); at24c32_init()
+ * must have run first.
+ */
+int settings_backend_init(void)
+{
+    int rc = scan();
+    if (rc)
+    {
+        LOG_ERR("settings area unreadable: %d", rc);
+        return rc;
+    }
+
+    settings_dst_register(&ee_store);
+    settings_src_register(&ee_store);
+    LOG_INF("settings: %u/%u bytes used", s_end, SETTINGS_EE_LEN);
+    return 0;
+}
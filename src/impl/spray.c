@@ -9,8 +9,11 @@
 #include "slider.h"
 #include "led_ctrl.h"
 #include "stats.h"
+#include "rollups.h"
 #include "mcp7940n.h"
 #include "tm_helpers.h"
+#include "at24c32.h"
+#include "adv.h"
 
 LOG_MODULE_REGISTER(SPRAY, LOG_LEVEL_INF);
 
@@ -29,6 +32,8 @@ static enum {
     STATE_MONITORING_CYCLE
 } current_state = STATE_IDLE;
 
+BUILD_ASSERT(STATE_MONITORING_CYCLE == SPRAY_STATE_MONITORING_CYCLE);
+
 struct phase_ctx
 {
     bool has_state;
@@ -36,6 +41,27 @@ struct phase_ctx
 };
 static struct phase_ctx phase_context;
 
+static spray_state_cb_t state_cb = NULL;
+
+/* Timer handlers change state too, so observers must not block. */
+static void set_state(int st)
+{
+    current_state = st;
+    if (state_cb)
+    {
+        state_cb();
+    }
+}
+
+static void cycle_state_changed(const struct cycle_state_t *st)
+{
+    ARG_UNUSED(st);
+    if (state_cb)
+    {
+        state_cb();
+    }
+}
+
 static void phase_timer_handler(struct k_timer *timer);
 static void blink_timer_handler(struct k_timer *timer);
 static void monitor_timer_handler(struct k_timer *timer);
@@ -50,6 +76,69 @@ struct cycle_work
 };
 static struct cycle_work start_cycle_work;
 
+/* One entry per spray still to be logged (state, only last 2 bits used).
+ * A work item resubmitted while pending runs once, so the states queue here
+ * and the handler drains them all.
+ */
+#define STATS_LOG_DEPTH 8
+K_MSGQ_DEFINE(stats_log_q, sizeof(uint8_t), STATS_LOG_DEPTH, 1);
+
+static void stats_log_one(uint8_t state)
+{
+    struct mcp7940n *rtc = mcp7940n_get();
+    struct tm now = {0};
+    int rc = mcp7940n_get_time(rtc, &now);
+    if (rc)
+    {
+        LOG_WRN("RTC read failed: %d (skipping stats append)", rc);
+    }
+    else if (!tm_sane(&now))
+    {
+        LOG_WRN("RTC time not sane (skipping stats append)");
+    }
+    else
+    {
+        uint8_t inten2b = (uint8_t)(state & 0x03);
+        int ok = stats_append_tm(&now, inten2b);
+        if (!ok)
+        {
+            LOG_WRN("stats: append failed (full or I/O error)");
+        }
+        else
+        {
+            (void)rollups_add(&now, inten2b);
+            adv_status_changed();
+
+            uint16_t cnt = stats_count();
+            if (cnt > 0)
+            {
+                struct tm ts = {0};
+                uint8_t st = 0xFF;
+                if (stats_get_tm((uint16_t)(cnt - 1), &ts, &st))
+                {
+                    char buf[64];
+                    LOG_INF("stats: count=%u, state=%u, %s",
+                            (unsigned)cnt, (unsigned)st, tm_to_str(&ts, buf, sizeof(buf)));
+                }
+            }
+        }
+    }
+}
+
+/* Runs on the EEPROM storage thread so the system workqueue never waits on
+ * the RTC read or on stats I/O before the servo moves.
+ */
+static void stats_log_work_handler(struct k_work *work)
+{
+    uint8_t state;
+    while (k_msgq_get(&stats_log_q, &state, K_NO_WAIT) == 0)
+    {
+        stats_log_one(state);
+    }
+}
+
+static K_WORK_DEFINE(stats_log_work, stats_log_work_handler);
+
 static void start_cycle_work_handler(struct k_work *work)
 {
     struct cycle_work *cw = CONTAINER_OF(work, struct cycle_work, work);
@@ -67,43 +156,11 @@ static void start_cycle_work_handler(struct k_work *work)
     LOG_INF("Configured cycle: spray=%dms, idle=%dms, repeats=%d (state=%u)",
             cfg_used.spray_ms, cfg_used.idle_ms, cfg_used.repeats, chosen_state);
 
+    if (k_msgq_put(&stats_log_q, &chosen_state, K_NO_WAIT))
     {
-        struct mcp7940n *rtc = mcp7940n_get();
-        struct tm now = {0};
-        int rc = mcp7940n_get_time(rtc, &now);
-        if (rc)
-        {
-            LOG_WRN("RTC read failed: %d (skipping stats append)", rc);
-        }
-        else if (!tm_sane(&now))
-        {
-            LOG_WRN("RTC time not sane (skipping stats append)");
-        }
-        else
-        {
-            uint8_t inten2b = (uint8_t)(chosen_state & 0x03);
-            int ok = stats_append_tm(&now, inten2b);
-            if (!ok)
-            {
-                LOG_WRN("stats: append failed (full or I/O error)");
-            }
-            else
-            {
-                uint8_t cnt8 = stats_count();
-                if (cnt8 > 0)
-                {
-                    struct tm ts = {0};
-                    uint8_t st = 0xFF;
-                    if (stats_get_tm((uint8_t)(cnt8 - 1), &ts, &st))
-                    {
-                        char buf[64];
-                        LOG_INF("stats: count=%u, state=%u, %s",
-                                (unsigned)cnt8, (unsigned)st, tm_to_str(&ts, buf, sizeof(buf)));
-                    }
-                }
-            }
-        }
+        LOG_WRN("stats: log queue full, spray not recorded");
     }
+    k_work_submit_to_queue(at24c32_workq(), &stats_log_work);
 
     cycle_start();
 
@@ -122,7 +179,7 @@ void spray_action(void)
 
     phase_context.has_state = false;
 
-    current_state = STATE_SLOW_BLINK;
+    set_state(STATE_SLOW_BLINK);
     led_spray_set(true);
 
     k_timer_start(&blink_timer, K_MSEC(500), K_MSEC(500));
@@ -144,7 +201,7 @@ void ble_spray_caller(uint8_t state)
     phase_context.state = state;
     phase_context.has_state = true;
 
-    current_state = STATE_SLOW_BLINK;
+    set_state(STATE_SLOW_BLINK);
     led_spray_set(true);
 
     k_timer_start(&blink_timer, K_MSEC(500), K_MSEC(500));
@@ -154,6 +211,7 @@ void ble_spray_caller(uint8_t state)
 
 void spray_button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
+    adv_wake();
     spray_action();
 }
 
@@ -165,7 +223,7 @@ static void phase_timer_handler(struct k_timer *timer)
     {
     case STATE_SLOW_BLINK:
         LOG_INF("Switching to fast blink");
-        current_state = STATE_FAST_BLINK;
+        set_state(STATE_FAST_BLINK);
 
         k_timer_stop(&blink_timer);
         k_timer_start(&blink_timer, K_MSEC(100), K_MSEC(100));
@@ -175,7 +233,7 @@ static void phase_timer_handler(struct k_timer *timer)
 
     case STATE_FAST_BLINK:
         LOG_INF("LED now solid");
-        current_state = STATE_SOLID;
+        set_state(STATE_SOLID);
 
         k_timer_stop(&blink_timer);
         led_spray_set(true);
@@ -218,7 +276,7 @@ static void monitor_timer_handler(struct k_timer *timer)
         if (cycle_state.phase == 0)
         {
             LOG_INF("Spray cycle completed");
-            current_state = STATE_IDLE;
+            set_state(STATE_IDLE);
             k_timer_stop(&monitor_timer);
             led_spray_set(false);
             phase_context.has_state = false;
@@ -233,7 +291,7 @@ static void monitor_timer_handler(struct k_timer *timer)
 static void start_spray_cycle(void)
 {
     LOG_INF("Starting spray cycle (auto/slider)");
-    current_state = STATE_MONITORING_CYCLE;
+    set_state(STATE_MONITORING_CYCLE);
     led_spray_set(true);
     start_cycle_work.has_state = false;
     k_work_submit(&start_cycle_work.work);
@@ -242,13 +300,23 @@ static void start_spray_cycle(void)
 static void start_spray_cycle_with_state(uint8_t state)
 {
     LOG_INF("Starting spray cycle (override state=%u)", state & 0x03);
-    current_state = STATE_MONITORING_CYCLE;
+    set_state(STATE_MONITORING_CYCLE);
     led_spray_set(true);
     start_cycle_work.state = (uint8_t)(state & 0x03);
     start_cycle_work.has_state = true;
     k_work_submit(&start_cycle_work.work);
 }
 
+uint8_t spray_get_state(void)
+{
+    return (uint8_t)current_state;
+}
+
+void spray_set_state_callback(spray_state_cb_t cb)
+{
+    state_cb = cb;
+}
+
 bool is_spray_cycle_active(void)
 {
     if (current_state == STATE_MONITORING_CYCLE)
@@ -265,7 +333,7 @@ void spray_stop(void)
     if (current_state == STATE_MONITORING_CYCLE)
     {
         cycle_stop();
-        current_state = STATE_IDLE;
+        set_state(STATE_IDLE);
         k_timer_stop(&monitor_timer);
         led_spray_set(false);
         phase_context.has_state = false;
@@ -274,7 +342,7 @@ void spray_stop(void)
     if (current_state != STATE_IDLE)
     {
         LOG_INF("Stopping sequence");
-        current_state = STATE_IDLE;
+        set_state(STATE_IDLE);
         k_timer_stop(&phase_timer);
         k_timer_stop(&blink_timer);
         led_spray_set(false);
@@ -307,6 +375,8 @@ int spray_init(void)
 
     k_timer_user_data_set(&phase_timer, &phase_context);
 
+    cycle_set_state_callback(cycle_state_changed);
+
     LOG_INF("Manual spray initialized successfully");
     return 0;
 }
@@ -1,58 +1,463 @@
 #include "stats.h"
 #include "at24c32.h"
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <string.h>
 #include "tm_helpers.h"
 
 LOG_MODULE_REGISTER(stats, LOG_LEVEL_INF);
 
+BUILD_ASSERT((STATS_BASE % AT24C32_PAGE_SIZE) == 0, "stats region must be page aligned");
+BUILD_ASSERT(STATS_BLK_LEN == AT24C32_PAGE_SIZE, "one block per EEPROM page");
+BUILD_ASSERT(STATS_BASE + STATS_TOTAL_LEN <= AT24C32_SIZE, "stats region past end of EEPROM");
+BUILD_ASSERT(STATS_BLOCKS <= UINT8_MAX, "block index is stored in one byte");
+
+#define SEQ_BLANK 0xFFFFFFFFu
+/* Largest delta an event can carry before it needs a block of its own */
+#define DELTA_LIMIT (TM_VARINT_LIMIT >> 2)
+
+/* Layout of the pre-log format (count byte + time array + 2-bit intensities),
+ * only needed to carry old entries over on first boot.
+ */
+#define LEGACY_CAP 254u
+#define LEGACY_TIMES_OFF (STATS_BASE + 1u)
+#define LEGACY_INT_OFF (LEGACY_TIMES_OFF + LEGACY_CAP * TIME_LEN)
+#define LEGACY_INT_LEN ((LEGACY_CAP + 3u) / 4u)
+
+/* RAM copy of the log bounds, rebuilt by stats_init_if_blank(). Appends run
+ * on the storage thread and reads come from the BT RX thread, so every
+ * public entry point holds s_lock (a k_mutex, so they can nest).
+ */
+static K_MUTEX_DEFINE(s_lock);
+
+static uint32_t s_base;      /* first sequence number since the last format/clear */
+static uint8_t s_start;      /* block the first event after format/clear went to */
+static bool s_empty = true;  /* no block written since format/clear */
+static uint8_t s_head_blk;   /* block receiving new events */
+static uint8_t s_head_off;   /* next free byte in the head block */
+static uint32_t s_head_time; /* time of the newest event */
+static uint8_t s_tail_blk;   /* oldest block still stored */
+static uint32_t s_tail_seq;  /* its first sequence number */
+static uint32_t s_head;      /* next sequence number to write */
+static uint32_t s_gen;       /* see stats_generation() */
+
 /* ========= local helpers ========= */
 
-static inline uint32_t time_addr(uint8_t idx)
+static inline uint16_t blk_addr(uint8_t blk)
+{
+    return (uint16_t)(STATS_LOG_OFF + (uint32_t)blk * STATS_BLK_LEN);
+}
+
+static inline uint8_t blk_next(uint8_t blk)
+{
+    return (uint8_t)((blk + 1u) % STATS_BLOCKS);
+}
+
+/* First sequence number stored in a block, or SEQ_BLANK. */
+static uint32_t blk_seq(uint8_t blk)
 {
-    return (uint32_t)STATS_TIMES_OFF + (uint32_t)idx * TIME_LEN;
+    uint8_t b[4];
+    if (at24c32_read_bytes(blk_addr(blk), b, sizeof(b)))
+    {
+        return SEQ_BLANK;
+    }
+    return sys_get_le32(b);
 }
-static inline uint16_t inten_byte_addr(uint8_t idx)
+
+static void blk_begin(uint8_t b[STATS_BLK_LEN], uint32_t seq, uint32_t when, uint8_t intensity2b)
 {
-    return (uint16_t)(STATS_INT_OFF + (idx >> 2)); // idx/4
+    memset(b, 0xFF, STATS_BLK_LEN);
+    sys_put_le32(seq, &b[0]);
+    sys_put_le32(when, &b[4]);
+    b[STATS_BLK_HDR_LEN] = intensity2b & 0x03u; /* delta 0 */
 }
-static inline uint8_t inten_shift(uint8_t idx)
+
+/* Encode an event following one at `last`; 0 if it needs a new block
+ * (clock went backwards or the gap is too large).
+ */
+static size_t ev_encode(uint32_t last, uint32_t when, uint8_t intensity2b,
+                        uint8_t out[TM_VARINT_MAX])
 {
-    return (uint8_t)((idx & 0x3u) * 2u);
+    if (when < last || when - last >= DELTA_LIMIT)
+    {
+        return 0;
+    }
+    return tm_varint_put(((when - last) << 2) | (intensity2b & 0x03u), out);
+}
+
+/* Sequential decoder over one block read into RAM */
+struct blk_iter
+{
+    const uint8_t *b;
+    uint8_t off;
+    uint32_t when;
+};
+
+static void blk_iter_init(struct blk_iter *it, const uint8_t b[STATS_BLK_LEN])
+{
+    it->b = b;
+    it->off = STATS_BLK_HDR_LEN;
+    it->when = sys_get_le32(&b[4]);
+}
+
+static bool blk_iter_next(struct blk_iter *it, uint32_t *when, uint8_t *intensity2b)
+{
+    uint32_t v;
+    const size_t len = tm_varint_get(&it->b[it->off], STATS_BLK_LEN - it->off, &v);
+    if (len == 0)
+    {
+        return false;
+    }
+
+    it->off = (uint8_t)(it->off + len);
+    it->when += v >> 2;
+    *when = it->when;
+    *intensity2b = (uint8_t)(v & 0x03u);
+    return true;
+}
+
+static int write_header(uint32_t seq_base, uint8_t start)
+{
+    uint8_t hdr[STATS_HDR_LEN];
+    memset(hdr, 0xFF, sizeof(hdr));
+    hdr[0] = 'S';
+    hdr[1] = 'T';
+    hdr[2] = STATS_VERSION;
+    hdr[3] = start;
+    sys_put_le32(seq_base, &hdr[4]);
+    return at24c32_write_page(STATS_HDR_OFF, hdr, sizeof(hdr));
+}
+
+static int erase_blk(uint8_t blk)
+{
+    uint8_t blank[STATS_BLK_LEN];
+    memset(blank, 0xFF, sizeof(blank));
+    return at24c32_write_page(blk_addr(blk), blank, sizeof(blank));
+}
+
+static int erase_log(void)
+{
+    for (uint8_t k = 0; k < STATS_BLOCKS; k++)
+    {
+        int rc = erase_blk(k);
+        if (rc)
+        {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+/* Rebuild the RAM bounds from the blocks. Walking the ring from the start
+ * block, blocks hold increasing sequence numbers up to the head and an
+ * older lap or blanks after it, so "not older than the start block" is a
+ * prefix predicate and the head is found by binary search.
+ */
+static void load_bounds(void)
+{
+    s_empty = true;
+    s_head = s_base;
+    s_tail_seq = s_base;
+    s_tail_blk = s_start;
+
+    const uint32_t seq0 = blk_seq(s_start);
+    if (seq0 == SEQ_BLANK)
+    {
+        return;
+    }
+
+    uint32_t lo = 1, hi = STATS_BLOCKS; /* answer in [lo, hi] */
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo + 1u) / 2u;
+        const uint32_t q = blk_seq((uint8_t)((s_start + mid - 1u) % STATS_BLOCKS));
+        if (q != SEQ_BLANK && q - s_base >= seq0 - s_base)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1u;
+        }
+    }
+    s_head_blk = (uint8_t)((s_start + lo - 1u) % STATS_BLOCKS);
+
+    uint8_t b[STATS_BLK_LEN];
+    if (at24c32_read_bytes(blk_addr(s_head_blk), b, sizeof(b)))
+    {
+        LOG_ERR("stats: read head block failed");
+        return;
+    }
+
+    struct blk_iter it;
+    uint32_t when;
+    uint8_t inten;
+    uint32_t n = 0;
+    blk_iter_init(&it, b);
+    s_head_time = it.when;
+    while (blk_iter_next(&it, &when, &inten))
+    {
+        s_head_time = when;
+        n++;
+    }
+    s_head = sys_get_le32(b) + n;
+    s_head_off = it.off;
+    s_empty = false;
+
+    // Past the head is the oldest block of the previous lap, if any
+    const uint8_t nxt = blk_next(s_head_blk);
+    const uint32_t q = blk_seq(nxt);
+    if (q != SEQ_BLANK && q - s_base < seq0 - s_base)
+    {
+        s_tail_blk = nxt;
+        s_tail_seq = q;
+    }
+    else
+    {
+        s_tail_blk = s_start;
+        s_tail_seq = seq0;
+    }
+}
+
+/* ========= migration from the pre-log layout ========= */
+
+/* Old entries, read oldest first by mig_convert() */
+struct mig_src
+{
+    uint32_t n; /* entries to carry over */
+    uint8_t ints[LEGACY_INT_LEN];
+};
+
+static int mig_get(const struct mig_src *m, uint32_t i, uint8_t t7[TIME_LEN], uint8_t *intensity2b)
+{
+    *intensity2b = (uint8_t)((m->ints[i >> 2] >> ((i & 3u) * 2u)) & 0x03u);
+    return at24c32_read_bytes((uint16_t)(LEGACY_TIMES_OFF + i * TIME_LEN), t7, TIME_LEN);
+}
+
+/* Does block `blk` still overlap an old entry at index >= i? */
+static bool mig_pending(const struct mig_src *m, uint8_t blk, uint32_t i)
+{
+    // Entry j occupies [LEGACY_TIMES_OFF + 7j, +7); intensities are already in RAM.
+    // Blocks start past LEGACY_TIMES_OFF, so this is never negative.
+    const uint32_t a = blk_addr(blk);
+    const uint32_t lo = (a - LEGACY_TIMES_OFF) / TIME_LEN;
+    const uint32_t hi = (a + STATS_BLK_LEN - 1u - LEGACY_TIMES_OFF) / TIME_LEN;
+    return i < m->n && MAX(lo, i) <= MIN(hi, m->n - 1u);
+}
+
+/* Re-encode old entries into blocks from `start` on, numbering them from
+ * seq0. Blocks are assembled in a small RAM queue and written only once no
+ * unread entry shares their page; compressed blocks stay behind the reader,
+ * so this only gives up (keeping the older entries) if the clock kept
+ * jumping back. Blocks not written are blanked. Returns the entries kept.
+ */
+#define MIG_QUEUE 3u
+
+static uint32_t mig_convert(const struct mig_src *m, uint8_t start, uint32_t seq0)
+{
+    uint8_t q[MIG_QUEUE][STATS_BLK_LEN];
+    uint32_t made = 0, used = 0; /* blocks started / written */
+    uint32_t last = 0, i;
+    uint8_t off = 0;
+
+    for (i = 0; i < m->n; i++)
+    {
+        uint8_t t7[TIME_LEN], inten;
+        if (mig_get(m, i, t7, &inten))
+        {
+            break;
+        }
+
+        const uint32_t when = tm7_to_epoch(t7);
+        uint8_t *cur = q[(made - 1u) % MIG_QUEUE];
+        uint8_t e[TM_VARINT_MAX];
+        const size_t len = made ? ev_encode(last, when, inten, e) : 0;
+        if (len && off + len <= STATS_BLK_LEN)
+        {
+            memcpy(&cur[off], e, len);
+            off = (uint8_t)(off + len);
+            last = when;
+            continue;
+        }
+
+        if (made == STATS_BLOCKS)
+        {
+            break;
+        }
+        if (made - used == MIG_QUEUE)
+        {
+            // Entry i is held in RAM; later ones may still share the page
+            const uint8_t blk = (uint8_t)((start + used) % STATS_BLOCKS);
+            if (mig_pending(m, blk, i + 1u) ||
+                at24c32_write_page(blk_addr(blk), q[used % MIG_QUEUE], STATS_BLK_LEN))
+            {
+                break;
+            }
+            used++;
+        }
+
+        blk_begin(q[made % MIG_QUEUE], seq0 + i, when, inten);
+        made++;
+        off = STATS_BLK_HDR_LEN + 1u;
+        last = when;
+    }
+
+    uint32_t kept = m->n;
+    for (; used < made; used++)
+    {
+        const uint8_t blk = (uint8_t)((start + used) % STATS_BLOCKS);
+        if (i < m->n || at24c32_write_page(blk_addr(blk), q[used % MIG_QUEUE], STATS_BLK_LEN))
+        {
+            kept = sys_get_le32(q[used % MIG_QUEUE]) - seq0;
+            break;
+        }
+    }
+
+    for (uint32_t k = used; k < STATS_BLOCKS; k++)
+    {
+        (void)erase_blk((uint8_t)((start + k) % STATS_BLOCKS));
+    }
+
+    LOG_INF("stats: migrated %u of %u entries into %u blocks",
+            (unsigned)kept, (unsigned)m->n, (unsigned)used);
+    return kept;
 }
 
 /* ========= public API ========= */
 
-void stats_init_if_blank(void)
+static void init_locked(void)
 {
-    uint8_t cnt = 0xFF;
-    int rc = at24c32_read_byte(STATS_COUNT_OFF, &cnt);
+    s_gen++;
+
+    uint8_t hdr[8];
+    int rc = at24c32_read_bytes(STATS_HDR_OFF, hdr, sizeof(hdr));
     if (rc)
     {
-        LOG_ERR("stats_init_if_blank: read count failed (%d)", rc);
+        LOG_ERR("stats_init_if_blank: read header failed (%d)", rc);
         return;
     }
 
-    // Without a magic byte: treat any invalid (> STATS_CAP) value (incl. 0xFF) as blank and zero it.
-    if (cnt > STATS_CAP)
+    if (hdr[0] == 'S' && hdr[1] == 'T' && hdr[2] == STATS_VERSION)
     {
-        (void)at24c32_write_byte(STATS_COUNT_OFF, 0);
-        LOG_INF("stats: initialized count=0 @0x%04X (was 0x%02X)", STATS_COUNT_OFF, cnt);
+        s_base = sys_get_le32(&hdr[4]);
+        s_start = (hdr[3] < STATS_BLOCKS) ? hdr[3] : 0u;
+        load_bounds();
+        LOG_INF("stats: log base=%u first=%u head=%u",
+                (unsigned)s_base, (unsigned)s_tail_seq, (unsigned)s_head);
+        return;
     }
+
+    struct mig_src m = {0};
+    uint8_t start = 0;
+
+    if (hdr[0] > 0 && hdr[0] <= LEGACY_CAP && !(hdr[0] == 'S' && hdr[1] == 'T'))
+    {
+        // Old layout kept a count byte at STATS_BASE; 0xFF, junk or a log
+        // header of another version means blank.
+        m.n = hdr[0];
+        if (at24c32_read_bytes(LEGACY_INT_OFF, m.ints, sizeof(m.ints)))
+        {
+            m.n = 0;
+        }
+        // Begin past the old arrays so the writer starts well clear of them
+        const uint32_t end = LEGACY_TIMES_OFF + m.n * TIME_LEN;
+        start = (end > STATS_LOG_OFF)
+                    ? (uint8_t)(((end - STATS_LOG_OFF + STATS_BLK_LEN - 1u) / STATS_BLK_LEN) % STATS_BLOCKS)
+                    : 0u;
+    }
+
+    if (m.n)
+    {
+        (void)mig_convert(&m, start, 0);
+    }
+    else
+    {
+        (void)erase_log();
+    }
+
+    (void)write_header(0, start);
+    s_base = 0;
+    s_start = start;
+    load_bounds();
+    LOG_INF("stats: formatted log @0x%04X (was %02X %02X %02X), %u entries",
+            STATS_BASE, hdr[0], hdr[1], hdr[2], (unsigned)(s_head - s_tail_seq));
+}
+
+void stats_init_if_blank(void)
+{
+    k_mutex_lock(&s_lock, K_FOREVER);
+    init_locked();
+    k_mutex_unlock(&s_lock);
+}
+
+static inline uint32_t first_seq(void)
+{
+    return s_empty ? s_head : s_tail_seq;
+}
+
+uint16_t stats_count(void)
+{
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint16_t n = (uint16_t)(s_head - s_tail_seq);
+    k_mutex_unlock(&s_lock);
+    return n;
+}
+
+uint32_t stats_head_seq(void)
+{
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint32_t head = s_head;
+    k_mutex_unlock(&s_lock);
+    return head;
+}
+
+uint32_t stats_first_seq(void)
+{
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint32_t first = first_seq();
+    k_mutex_unlock(&s_lock);
+    return first;
 }
 
-uint8_t stats_count(void)
+void stats_bounds(uint32_t *first, uint32_t *head)
 {
-    uint8_t cnt = 0;
-    int rc = at24c32_read_byte(STATS_COUNT_OFF, &cnt);
+    k_mutex_lock(&s_lock, K_FOREVER);
+    *first = first_seq();
+    *head = s_head;
+    k_mutex_unlock(&s_lock);
+}
+
+/* Start a fresh block for an event that does not fit the head block. When
+ * every block is in use this overwrites the oldest one.
+ */
+static int blk_start(uint32_t when, uint8_t intensity2b)
+{
+    const uint8_t blk = s_empty ? s_start : blk_next(s_head_blk);
+
+    uint8_t b[STATS_BLK_LEN];
+    blk_begin(b, s_head, when, intensity2b);
+    int rc = at24c32_write_page(blk_addr(blk), b, sizeof(b));
     if (rc)
     {
-        LOG_ERR("stats_count: read failed (%d)", rc);
-        return 0;
+        return rc;
+    }
+
+    if (s_empty)
+    {
+        s_tail_blk = blk;
+        s_tail_seq = s_head;
+    }
+    else if (blk == s_tail_blk)
+    {
+        s_tail_blk = blk_next(blk);
+        s_tail_seq = blk_seq(s_tail_blk);
     }
-    if (cnt > STATS_CAP)
-        return 0; // invalid persisted value; treat as empty
-    return cnt;
+
+    s_empty = false;
+    s_head_blk = blk;
+    s_head_off = STATS_BLK_HDR_LEN + 1u;
+    return 0;
 }
 
 int stats_append(const uint8_t time[TIME_LEN], uint8_t intensity2b)
@@ -60,82 +465,175 @@ int stats_append(const uint8_t time[TIME_LEN], uint8_t intensity2b)
     if (!time)
         return 0;
 
-    uint8_t cnt = stats_count();
-    if (cnt >= STATS_CAP)
+    const uint32_t when = tm7_to_epoch(time);
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+
+    // Normally just the 1-4 byte delta is written into the head block
+    uint8_t e[TM_VARINT_MAX];
+    const size_t len = s_empty ? 0 : ev_encode(s_head_time, when, intensity2b, e);
+    int rc;
+    if (len && s_head_off + len <= STATS_BLK_LEN)
     {
-        LOG_WRN("stats_append: capacity reached (%u), not appending", (unsigned)STATS_CAP);
-        return 0; // stop when full; ask if you want ring overwrite
+        rc = at24c32_write_page((uint16_t)(blk_addr(s_head_blk) + s_head_off), e, len);
+        if (rc == 0)
+        {
+            s_head_off = (uint8_t)(s_head_off + len);
+        }
     }
-
-    // 1) Write time first (driver will split across page boundaries)
-    const uint32_t taddr = time_addr(cnt);
-    int rc = at24c32_write_bytes((uint16_t)taddr, time, TIME_LEN);
-    if (rc)
+    else
     {
-        LOG_ERR("stats_append: write time failed (%d)", rc);
-        return 0;
+        rc = blk_start(when, intensity2b);
     }
 
-    // 2) Pack the 2-bit intensity into its byte
-    const uint16_t ibyte = inten_byte_addr(cnt);
-    const uint8_t sh = inten_shift(cnt);
-    const uint8_t mask = (uint8_t)(0x03u << sh);
-    const uint8_t val = (uint8_t)((intensity2b & 0x03u) << sh);
+    if (rc == 0)
+    {
+        s_head_time = when;
+        s_head++;
+        s_gen++;
+    }
+    k_mutex_unlock(&s_lock);
 
-    rc = at24c32_update_bits(ibyte, mask, val);
     if (rc)
     {
-        LOG_ERR("stats_append: update intensity failed (%d)", rc);
+        LOG_ERR("stats_append: write failed (%d)", rc);
         return 0;
     }
+    return 1;
+}
 
-    // 3) Bump count last (power-loss friendly)
-    rc = at24c32_write_byte(STATS_COUNT_OFF, (uint8_t)(cnt + 1));
-    if (rc)
+int stats_get(uint16_t index, uint8_t out_time[TIME_LEN], uint8_t *out_int2b)
+{
+    int ok = 0;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    if (index < (uint16_t)(s_head - s_tail_seq))
     {
-        LOG_ERR("stats_append: bump count failed (%d)", rc);
-        return 0;
+        ok = stats_get_seq(first_seq() + index, out_time, out_int2b);
     }
+    k_mutex_unlock(&s_lock);
+    return ok;
+}
+
+int stats_get_seq(uint32_t seq, uint8_t out_time[TIME_LEN], uint8_t *out_int2b)
+{
+    struct stats_entry e;
+    if (!out_time || stats_get_range(seq, 1, &e) != 1)
+        return 0;
 
+    memcpy(out_time, e.time, TIME_LEN);
+    if (out_int2b)
+    {
+        *out_int2b = e.int2b;
+    }
     return 1;
 }
 
-int stats_get(uint8_t index, uint8_t out_time[TIME_LEN], uint8_t *out_int2b)
+/* Block holding `seq` (which must be stored): the last block, from the
+ * tail on, whose first sequence number is not past it. Caller holds s_lock.
+ */
+static uint8_t blk_find(uint32_t seq)
 {
-    uint8_t cnt = stats_count();
-    if (index >= cnt)
-        return 0;
+    const uint32_t first = first_seq();
+    uint32_t lo = 0, hi = (s_head_blk + STATS_BLOCKS - s_tail_blk) % STATS_BLOCKS;
 
-    // read time
-    int rc = at24c32_read_bytes((uint16_t)time_addr(index), out_time, TIME_LEN);
-    if (rc)
+    while (lo < hi)
     {
-        LOG_ERR("stats_get: read time failed (%d)", rc);
-        return 0;
+        const uint32_t mid = lo + (hi - lo + 1u) / 2u;
+        const uint32_t q = blk_seq((uint8_t)((s_tail_blk + mid) % STATS_BLOCKS));
+        if (q != SEQ_BLANK && q - first <= seq - first)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1u;
+        }
     }
+    return (uint8_t)((s_tail_blk + lo) % STATS_BLOCKS);
+}
 
-    // read intensity byte then extract 2 bits
-    uint8_t ib = 0;
-    rc = at24c32_read_byte(inten_byte_addr(index), &ib);
-    if (rc)
+uint8_t stats_get_range(uint32_t start_seq, uint8_t n, struct stats_entry out[])
+{
+    if (!out)
+        return 0;
+
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint32_t first = first_seq();
+    if (start_seq - first >= s_head - first)
     {
-        LOG_ERR("stats_get: read intensity byte failed (%d)", rc);
+        k_mutex_unlock(&s_lock);
         return 0;
     }
 
-    if (out_int2b)
+    n = (uint8_t)MIN((uint32_t)n, s_head - start_seq);
+
+    uint8_t blk = blk_find(start_seq);
+    uint8_t got = 0;
+
+    while (got < n)
     {
-        *out_int2b = (uint8_t)((ib >> inten_shift(index)) & 0x03u);
+        uint8_t b[STATS_BLK_LEN];
+        int rc = at24c32_read_bytes(blk_addr(blk), b, sizeof(b));
+        if (rc)
+        {
+            LOG_ERR("stats_get_range: read failed (%d)", rc);
+            break;
+        }
+
+        const uint32_t want = start_seq + got;
+        uint32_t seq = sys_get_le32(b);
+        if (want - seq >= STATS_BLK_MAX)
+        {
+            LOG_ERR("stats_get_range: block %u starts at %u, want %u",
+                    blk, (unsigned)seq, (unsigned)want);
+            break;
+        }
+
+        struct blk_iter it;
+        uint32_t when;
+        uint8_t inten;
+        blk_iter_init(&it, b);
+        while (got < n && blk_iter_next(&it, &when, &inten))
+        {
+            if (seq++ < want)
+                continue;
+            tm7_from_epoch(out[got].time, when);
+            out[got].int2b = inten;
+            got++;
+        }
+
+        blk = blk_next(blk);
     }
-    return 1;
+    k_mutex_unlock(&s_lock);
+
+    return got;
 }
 
 void stats_clear(void)
 {
-    (void)at24c32_write_byte(STATS_COUNT_OFF, 0);
-    // Optional: zero intensity region for cleanliness (not required).
-    // for (uint32_t a = STATS_INT_OFF; a < STATS_INT_OFF + STATS_INT_LEN; ++a)
-    //     (void)at24c32_write_byte((uint16_t)a, 0);
+    k_mutex_lock(&s_lock, K_FOREVER);
+    // Keep counting from the current head so sequence numbers stay unique,
+    // and start the next block after the current head to spread wear.
+    const uint8_t start = s_empty ? s_start : blk_next(s_head_blk);
+    if (erase_log() == 0 && write_header(s_head, start) == 0)
+    {
+        s_base = s_head;
+        s_start = start;
+        s_empty = true;
+        s_tail_blk = start;
+        s_tail_seq = s_head;
+    }
+    s_gen++;
+    k_mutex_unlock(&s_lock);
+}
+
+uint32_t stats_generation(void)
+{
+    k_mutex_lock(&s_lock, K_FOREVER);
+    const uint32_t gen = s_gen;
+    k_mutex_unlock(&s_lock);
+    return gen;
 }
 
 /* ---------- struct tm wrappers ---------- */
@@ -149,7 +647,7 @@ int stats_append_tm(const struct tm *t, uint8_t intensity2b)
     return stats_append(buf, intensity2b);
 }
 
-int stats_get_tm(uint8_t index, struct tm *out_t, uint8_t *out_int2b)
+int stats_get_tm(uint16_t index, struct tm *out_t, uint8_t *out_int2b)
 {
     if (!out_t)
         return 0;
@@ -36,6 +36,138 @@ void tm_from_7(struct tm *t, const uint8_t in[7])
     t->tm_year = in[6]; /* years since 1900 */
 }
 
+/* Day count since 2000-01-01 for a proleptic Gregorian date (month 1..12) */
+static int32_t days_from_civil(int y, int m, int d)
+{
+    y -= (m <= 2);
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 730425; /* 730425 = days from 0000-03-01 to 2000-01-01 */
+}
+
+uint32_t tm_to_epoch(const struct tm *t)
+{
+    const int32_t days = days_from_civil(t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
+    return (uint32_t)days * 86400u +
+           (uint32_t)(t->tm_hour * 3600 + t->tm_min * 60 + t->tm_sec);
+}
+
+void tm_from_epoch(struct tm *t, uint32_t secs)
+{
+    memset(t, 0, sizeof(*t));
+
+    const int32_t days = (int32_t)(secs / 86400u);
+    uint32_t rem = secs % 86400u;
+    t->tm_hour = (int)(rem / 3600u);
+    rem %= 3600u;
+    t->tm_min = (int)(rem / 60u);
+    t->tm_sec = (int)(rem % 60u);
+    t->tm_wday = (int)((days + 6) % 7); /* 2000-01-01 was a Saturday */
+
+    const int32_t z = days + 730425;
+    const int32_t era = z / 146097;
+    const int32_t doe = z - era * 146097;
+    const int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int32_t mp = (5 * doy + 2) / 153;
+    const int32_t m = mp < 10 ? mp + 3 : mp - 9;
+
+    t->tm_mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+    t->tm_mon = (int)(m - 1);
+    t->tm_year = (int)(yoe + era * 400 + (m <= 2) - 1900);
+}
+
+uint32_t tm7_to_epoch(const uint8_t in[7])
+{
+    struct tm t;
+    tm_from_7(&t, in);
+    return tm_to_epoch(&t);
+}
+
+void tm7_from_epoch(uint8_t out[7], uint32_t secs)
+{
+    struct tm t;
+    tm_from_epoch(&t, secs);
+    tm_to_7(&t, out);
+}
+
+size_t tm_varint_put(uint32_t v, uint8_t out[TM_VARINT_MAX])
+{
+    if (v < (1u << 7))
+    {
+        out[0] = (uint8_t)v;
+        return 1;
+    }
+    if (v < (1u << 14))
+    {
+        out[0] = (uint8_t)(0x80u | (v >> 8));
+        out[1] = (uint8_t)v;
+        return 2;
+    }
+    if (v < (1u << 21))
+    {
+        out[0] = (uint8_t)(0xC0u | (v >> 16));
+        out[1] = (uint8_t)(v >> 8);
+        out[2] = (uint8_t)v;
+        return 3;
+    }
+    if (v < TM_VARINT_LIMIT)
+    {
+        out[0] = (uint8_t)(0xE0u | (v >> 24));
+        out[1] = (uint8_t)(v >> 16);
+        out[2] = (uint8_t)(v >> 8);
+        out[3] = (uint8_t)v;
+        return 4;
+    }
+    return 0; /* does not fit */
+}
+
+size_t tm_varint_get(const uint8_t *in, size_t avail, uint32_t *v)
+{
+    if (avail == 0)
+        return 0;
+
+    const uint8_t b0 = in[0];
+    size_t n;
+    uint32_t acc;
+
+    if ((b0 & 0x80u) == 0)
+    {
+        n = 1;
+        acc = b0;
+    }
+    else if ((b0 & 0xC0u) == 0x80u)
+    {
+        n = 2;
+        acc = b0 & 0x3Fu;
+    }
+    else if ((b0 & 0xE0u) == 0xC0u)
+    {
+        n = 3;
+        acc = b0 & 0x1Fu;
+    }
+    else if ((b0 & 0xF0u) == 0xE0u)
+    {
+        n = 4;
+        acc = b0 & 0x0Fu;
+    }
+    else
+    {
+        return 0; /* 0xFF terminator (or corrupt) */
+    }
+
+    if (n > avail)
+        return 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        acc = (acc << 8) | in[i];
+    }
+    *v = acc;
+    return n;
+}
+
 int tm_cmp(const struct tm *a, const struct tm *b)
 {
     // if (a->tm_year != b->tm_year)
@@ -8,6 +8,7 @@
 #include <zephyr/bluetooth/services/bas.h>
 
 #include "led_ctrl.h" /* for led_red_set(), led_green_set(), led_blue_set() */
+#include "adv.h"
 
 LOG_MODULE_REGISTER(VBAT, LOG_LEVEL_INF);
 
@@ -148,6 +149,7 @@ static void sample_fn(struct k_work *work)
                 raw, mv, battery_percent);
 
         apply_leds_for_percent(battery_percent);
+        adv_status_changed();
 
         err = bt_bas_set_battery_level(battery_percent);
         if (err)
@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Advertising. Besides name and service UUID the advertising data carries
+ * a manufacturer-specific status block, so a passive scan reads battery,
+ * cycle phase, total sprays and schedule state without connecting:
+ *
+ *   [company u16][ver u8][battery % u8][phase u8][total sprays u32][flags u8]
+ *
+ * The payload is rebuilt and pushed with bt_le_adv_update_data() whenever
+ * adv_status_changed() finds that one of the fields moved.
+ */
+#define ADV_MFG_COMPANY_ID 0xFFFFu /* no SIG company ID assigned: test range */
+#define ADV_MFG_VERSION 1u
+#define ADV_MFG_LEN 10u
+
+#define ADV_FLAG_SCHEDULE_ARMED 0x01u
+
+/*
+ * Advertising runs in phases: a fast burst after boot, a button press or a
+ * disconnect, then a slower phase, then low-duty beacons until the next
+ * wake. It continues (from the slow phase) while connected as long as a
+ * connection slot is free. Intervals in 0.625 ms units.
+ */
+#define ADV_FAST_INT_MIN 48u /* 30 ms */
+#define ADV_FAST_INT_MAX 60u /* 37.5 ms */
+#define ADV_FAST_MS 30000u
+
+#define ADV_SLOW_INT_MIN 244u /* 152.5 ms */
+#define ADV_SLOW_INT_MAX 338u /* 211.25 ms */
+#define ADV_SLOW_MS 120000u
+
+#define ADV_BEACON_INT_MIN 3200u /* 2 s */
+#define ADV_BEACON_INT_MAX 3360u /* 2.1 s */
+
+   enum adv_phase
+   {
+      ADV_PHASE_OFF, /* connected, or start failed and waiting to retry */
+      ADV_PHASE_FAST,
+      ADV_PHASE_SLOW,
+      ADV_PHASE_BEACON,
+      ADV_PHASE_COUNT
+   };
+
+   struct adv_phase_stats
+   {
+      uint32_t entered;     /* times the phase was started */
+      uint32_t connections; /* connections made while in it */
+      uint32_t ms;          /* total time spent in it */
+   };
+
+   void adv_start(void);
+   bool adv_is_active(void);
+
+   /* Restart the fast phase (button press, connection slot recycled).
+    * Safe from ISR context.
+    */
+   void adv_wake(void);
+
+   /* Called from the connection callbacks in main.c */
+   void adv_on_connected(void);
+   void adv_on_disconnected(void);
+
+   enum adv_phase adv_get_phase(void);
+   void adv_get_stats(enum adv_phase p, struct adv_phase_stats *out);
+
+   /* Re-read the status fields and update the payload if any changed.
+    * Safe from ISR context; the work runs on the system workqueue.
+    */
+   void adv_status_changed(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,7 @@
 #define AT24C32_H
 
 #include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -20,6 +21,26 @@
 #define AT24C32_PAGE_SIZE 32u                /* 32-byte page size */
 #define AT24C32_MAX_ADDR (AT24C32_SIZE - 1u) /* Maximum address (0x0FFF) */
 
+/* Write-back cache: writes land in RAM page frames and are programmed to the
+ * chip (one page write per dirty page) after AT24C32_CACHE_IDLE_MS without
+ * further writes, on eviction, or on at24c32_flush().
+ */
+#define AT24C32_CACHE_FRAMES 4u      /* 32-byte page frames held in RAM */
+#define AT24C32_CACHE_IDLE_MS 250u   /* idle time before dirty pages are flushed */
+
+/* Mirror mode: at24c32_init() loads the whole device into a 4 KB RAM image
+ * and every read is served from it; writes update the image and then go to
+ * the chip through the cache above. Set to 0 to read from the bus instead.
+ */
+#ifndef AT24C32_MIRROR
+#define AT24C32_MIRROR 1
+#endif
+#define AT24C32_MIRROR_CHUNK 128u /* bytes per boot burst; TWIM MAXCNT is 255 */
+
+/* Storage thread: runs async jobs and the idle flush, below all app threads */
+#define AT24C32_WORKQ_STACK_SIZE 1024
+#define AT24C32_WORKQ_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+
 int at24c32_init(void);
 int at24c32_is_ready(void);
 
@@ -38,4 +59,41 @@ int at24c32_clear_page(uint16_t page_num);
 
 int at24c32_update_bits(uint16_t addr, uint8_t mask, uint8_t value);
 
+/* Program all dirty cached pages to the chip now. */
+int at24c32_flush(void);
+
+/* ---- Asynchronous jobs ----
+ * A submitted job runs on the storage thread, in submission order, and its
+ * callback is invoked there with the result. `buf` is the source for writes
+ * and the destination for reads; it and the job itself must stay valid until
+ * the callback runs. A job may be resubmitted from its own callback.
+ */
+enum at24c32_op
+{
+    AT24C32_OP_READ,
+    AT24C32_OP_WRITE,
+    AT24C32_OP_FLUSH,
+};
+
+struct at24c32_job;
+typedef void (*at24c32_job_cb_t)(struct at24c32_job *job, int result);
+
+struct at24c32_job
+{
+    struct k_work work; /* internal */
+    enum at24c32_op op;
+    uint16_t addr;
+    uint8_t *buf;
+    size_t len;
+    at24c32_job_cb_t cb;
+    void *user;
+};
+
+int at24c32_submit(struct at24c32_job *job);
+
+/* The storage thread's queue, for callers that need a multi-step EEPROM
+ * transaction off their own thread.
+ */
+struct k_work_q *at24c32_workq(void);
+
 #endif /* AT24C32_H */
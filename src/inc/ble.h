@@ -7,6 +7,7 @@ extern "C"
 #endif
 
 #include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
 
 #define BT_UUID_MACHHAR_SERVICE_VAL \
     BT_UUID_128_ENCODE(0x00004000, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
@@ -18,6 +19,16 @@ extern "C"
     BT_UUID_128_ENCODE(0x00004003, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
 #define BT_UUID_MACHHAR_REMOTE_SPRAY_VAL \
     BT_UUID_128_ENCODE(0x00004004, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+#define BT_UUID_MACHHAR_ROLLUPS_VAL \
+    BT_UUID_128_ENCODE(0x00004005, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+#define BT_UUID_MACHHAR_STATS_STREAM_VAL \
+    BT_UUID_128_ENCODE(0x00004006, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+#define BT_UUID_MACHHAR_CYCLE_STATE_VAL \
+    BT_UUID_128_ENCODE(0x00004007, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+#define BT_UUID_MACHHAR_WRITE_STATUS_VAL \
+    BT_UUID_128_ENCODE(0x00004008, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+#define BT_UUID_MACHHAR_BATCH_VAL \
+    BT_UUID_128_ENCODE(0x00004009, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
 
 #define BT_UUID_MACHHAR_SERVICE \
     BT_UUID_DECLARE_128(BT_UUID_MACHHAR_SERVICE_VAL)
@@ -29,6 +40,37 @@ extern "C"
     BT_UUID_DECLARE_128(BT_UUID_MACHHAR_STATISTICS_VAL)
 #define BT_UUID_MACHHAR_REMOTE_SPRAY \
     BT_UUID_DECLARE_128(BT_UUID_MACHHAR_REMOTE_SPRAY_VAL)
+#define BT_UUID_MACHHAR_ROLLUPS \
+    BT_UUID_DECLARE_128(BT_UUID_MACHHAR_ROLLUPS_VAL)
+#define BT_UUID_MACHHAR_STATS_STREAM \
+    BT_UUID_DECLARE_128(BT_UUID_MACHHAR_STATS_STREAM_VAL)
+#define BT_UUID_MACHHAR_CYCLE_STATE \
+    BT_UUID_DECLARE_128(BT_UUID_MACHHAR_CYCLE_STATE_VAL)
+#define BT_UUID_MACHHAR_WRITE_STATUS \
+    BT_UUID_DECLARE_128(BT_UUID_MACHHAR_WRITE_STATUS_VAL)
+#define BT_UUID_MACHHAR_BATCH \
+    BT_UUID_DECLARE_128(BT_UUID_MACHHAR_BATCH_VAL)
+
+/* Batch write TLVs: [type u8][len u16 LE][value], the value being exactly
+ * what the single-purpose characteristic takes. Each type at most once.
+ */
+#define BLE_TLV_HDR_LEN 3u
+#define BLE_TLV_TIME 0x01u     /* time7, as on Time sync */
+#define BLE_TLV_SCHEDULE 0x02u /* schedule image, as on Scheduling */
+#define BLE_TLV_STATS 0x03u    /* as on the Statistics control write */
+#define BLE_TLV_SPRAY 0x04u    /* as on Remote spray */
+#define BLE_TLV_COUNT 5u
+
+/* Queue a Cycle State notification; safe from ISR context. */
+void ble_cycle_state_notify(void);
+
+/* Validate a schedule payload (the image of schedule.h, or one of the
+ * older [count u8] + rules/entries forms) and queue it for commit; the
+ * result is reported on conn's Write Status. -EMSGSIZE bad length or format,
+ * -ERANGE bad count, item or time, or more than SCHED_DAYSETS weekday
+ * masks; -EBUSY a previous upload is still committing.
+ */
+int ble_schedule_submit(struct bt_conn *conn, const uint8_t *p, uint16_t len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Bulk transfers over an L2CAP connection-oriented channel (LE credit
+ * based flow control), one channel per connection on BULK_PSM. The
+ * channel needs an encrypted link (BT_SECURITY_L2).
+ *
+ * The client sends one command per SDU:
+ *   BULK_CMD_STATS     [cmd][since_seq u32]
+ *   BULK_CMD_EEPROM    [cmd][addr u16][len u16]   len 0 = up to the end;
+ *                      -EACCES if the range touches the settings area
+ *   BULK_CMD_SCHEDULE  [cmd] then a schedule image, as on the Scheduling
+ *                      write (older forms too, up to the image size)
+ *
+ * The reply is a byte stream, cut into SDUs of up to BULK_SDU_MAX bytes
+ * (or the peer's MTU) at arbitrary points:
+ *   [cmd u8][status s8][len u32] then len bytes of body
+ * status is 0 or a negative errno; on error len is 0.
+ *
+ * Bodies:
+ *   STATS     [start_seq u32][head_seq u32] then head_seq - start_seq
+ *             entries of [time7][intensity], as on the Statistics read.
+ *             start_seq > since_seq means older events were overwritten;
+ *             all-zero entries were overwritten while the export ran.
+ *   EEPROM    the raw bytes, for a backup image of the app regions
+ *             (SCHED_BASE up). The settings area below holds bond keys
+ *             and is never exported; the settings compaction journal
+ *             reads as 0xFF.
+ *   SCHEDULE  empty; the upload is queued and the commit result follows
+ *             on this connection's Write Status, as for the Scheduling
+ *             write.
+ *
+ * One command at a time per channel: a command sent while a reply is
+ * still streaming is dropped.
+ */
+#define BULK_PSM 0x0085u /* LE dynamic range 0x0080-0x00FF */
+#define BULK_SDU_MAX 512u
+
+#define BULK_RSP_HDR_LEN 6u
+
+#define BULK_CMD_STATS 0x01u
+#define BULK_CMD_EEPROM 0x02u
+#define BULK_CMD_SCHEDULE 0x03u
+
+   /* Register the L2CAP server; call after bt_enable() */
+   int bulk_init(void);
+
+#ifdef __cplusplus
+}
+#endif
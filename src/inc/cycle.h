@@ -15,7 +15,13 @@ struct cycle_state_t
     uint16_t cycle_index;  /* completed Spray->Idle iterations */
 };
 
+/* Called (from the system workqueue or the caller's context) whenever
+ * phase or cycle_index changes; remaining_ms is as of that moment.
+ */
+typedef void (*cycle_state_cb_t)(const struct cycle_state_t *st);
+
 int cycle_init(void);
+void cycle_set_state_callback(cycle_state_cb_t cb);
 void cycle_tick_start(void);
 void cycle_tick_stop(void);
 
@@ -0,0 +1,34 @@
+#pragma once
+#include <zephyr/bluetooth/conn.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Link tuning. On connect the firmware asks for the largest ATT MTU, data
+ * length extension and the 2M PHY, and puts the link in "bulk" mode: a
+ * short connection interval for discovery and the first sync. Once no
+ * transfer has touched the link for LINK_IDLE_AFTER_MS it drops back to a
+ * relaxed, low-power interval; link_bulk() switches it back on demand.
+ */
+
+/* Connection intervals in 1.25 ms units, supervision timeout in 10 ms units */
+#define LINK_BULK_INT_MIN 6u  /* 7.5 ms */
+#define LINK_BULK_INT_MAX 12u /* 15 ms */
+#define LINK_IDLE_INT_MIN 80u  /* 100 ms */
+#define LINK_IDLE_INT_MAX 160u /* 200 ms */
+#define LINK_IDLE_LATENCY 4u
+#define LINK_SUP_TIMEOUT 400u /* 4 s */
+
+#define LINK_IDLE_AFTER_MS 3000u
+
+   /* Mark the start (or continuation) of a transfer on conn: switch to the
+    * bulk interval if needed and push back the return to idle.
+    */
+   void link_bulk(struct bt_conn *conn);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * ===== Usage rollups =====
+ *
+ * Aggregates updated on every logged spray, so a dashboard needs one small
+ * read instead of downloading the raw statistics log. They are not limited
+ * by the log size: older events keep counting after being overwritten.
+ *
+ * Counting happens in RAM. The image is checkpointed to ROLLUP_BASE at most
+ * once per ROLLUP_CKPT_MS after a spray, followed by a trailer
+ *   [stats_seq u32][crc8 (CCITT) over the image and stats_seq]
+ * and at boot the events logged since stats_seq are replayed from the
+ * statistics log, so a reset loses nothing that is still in the log. With
+ * no valid checkpoint the image is rebuilt from the whole log.
+ *
+ * Image, all values little-endian:
+ *   [0..1]   'R','U'
+ *   [2]      ROLLUP_VERSION
+ *   [3]      0xFF
+ *   [4..5]   last_day  : newest day counted, days since 2000-01-01
+ *   [6..7]   0xFFFF
+ *   [8..23]  spray_ms  : u32 x 4, total spray time per intensity
+ *   [24..]   days      : u16 x ROLLUP_DAYS, day d counted in slot d % ROLLUP_DAYS,
+ *                        covering (last_day - ROLLUP_DAYS, last_day]
+ *   [..]     how       : u16 x 168, hour-of-week histogram (wday * 24 + hour,
+ *                        0 = Sunday 00:xx)
+ *
+ * The GATT characteristic returns this image as is.
+ */
+
+#define ROLLUP_BASE ((uint16_t)0x0E00u)
+#define ROLLUP_VERSION 1u
+
+#define ROLLUP_DAYS 32u
+#define ROLLUP_HOW_BUCKETS (7u * 24u)
+
+#define ROLLUP_HDR_LEN 8u
+#define ROLLUP_MS_OFF ROLLUP_HDR_LEN
+#define ROLLUP_DAYS_OFF (ROLLUP_MS_OFF + 4u * 4u)
+#define ROLLUP_HOW_OFF (ROLLUP_DAYS_OFF + ROLLUP_DAYS * 2u)
+#define ROLLUP_TOTAL_LEN (ROLLUP_HOW_OFF + ROLLUP_HOW_BUCKETS * 2u)
+
+#define ROLLUP_CKPT_TRAILER_LEN 5u
+#define ROLLUP_CKPT_LEN (ROLLUP_TOTAL_LEN + ROLLUP_CKPT_TRAILER_LEN)
+#define ROLLUP_CKPT_MS (60u * 60u * 1000u) /* hourly */
+
+   /* Load the checkpoint and replay what was logged after it (or rebuild
+    * from the whole statistics log), so call after stats_init_if_blank().
+    */
+   void rollups_init(void);
+
+   /* Count one spray at time t with the given intensity. */
+   int rollups_add(const struct tm *t, uint8_t intensity2b);
+
+   /* Copy up to len bytes of the image starting at offset; returns the
+    * number of bytes copied.
+    */
+   size_t rollups_read(size_t offset, uint8_t *out, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
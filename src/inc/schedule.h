@@ -1,4 +1,5 @@
 #pragma once
+#include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -7,26 +8,112 @@ extern "C"
 {
 #endif
 
-/* Layout (unchanged) */
+/* The schedule is a list of items "at this minute of the day, on these
+ * weekdays, spray at this intensity", kept sorted by minute. An item is a
+ * u16:
+ *   bits 0..10   minute of day (0..1439)
+ *   bits 11..12  intensity (0..3)
+ *   bits 13..15  day set: index into days[], the weekday masks
+ * A weekday mask has bit n for tm_wday n (bit 0 Sunday), so a spray every
+ * 15 minutes from 8:00 to 18:00 on weekdays is 41 items sharing one day set
+ * of 0x3E. Up to SCHED_DAYSETS distinct masks per schedule.
+ *
+ * Layout at SCHED_BASE, the same image as on the Scheduling characteristic:
+ *   [0]     count (0..SCHED_CAP); 0xFF => blank
+ *   [1]     SCHED_FORMAT
+ *   [2..9]  days[SCHED_DAYSETS]; unused sets are 0
+ *   [10..]  count items, u16 LE, sorted by minute (ties keep upload order)
+ * A part in an older layout is converted at boot: 4-byte rules
+ * ([hour][min][days][intensity], format 0xA2) keep their masks, and the
+ * original absolute entries become daily items at their hour:minute, which
+ * is how they fired anyway (tm_cmp() never looked at the date).
+ */
 #define SCHED_BASE 0x0400u
-#define SCHED_CAP 5u
-#define SCHED_TIME_LEN 7u
+#define SCHED_CAP 64u
+#define SCHED_FORMAT 0xA3u
+#define SCHED_DAYSETS 8u
+#define SCHED_ITEM_LEN 2u
 
 #define SCHED_COUNT_OFF (SCHED_BASE + 0u)
-#define SCHED_TIMES_OFF (SCHED_BASE + 1u)
-#define SCHED_TIMES_LEN ((uint32_t)SCHED_CAP * SCHED_TIME_LEN)
-#define SCHED_INT_OFF (SCHED_TIMES_OFF + SCHED_TIMES_LEN)
-#define SCHED_INT_LEN ((SCHED_CAP + 3u) / 4u)
-#define SCHED_TOTAL_LEN (1u + SCHED_TIMES_LEN + SCHED_INT_LEN)
+#define SCHED_FORMAT_OFF (SCHED_BASE + 1u)
+#define SCHED_DAYS_OFF (SCHED_BASE + 2u)
+#define SCHED_HDR_LEN (2u + SCHED_DAYSETS)
+#define SCHED_ITEMS_OFF (SCHED_BASE + SCHED_HDR_LEN)
+#define SCHED_TOTAL_LEN (SCHED_HDR_LEN + SCHED_CAP * SCHED_ITEM_LEN)
+
+#define SCHED_DAYS_ALL 0x7Fu
+#define SCHED_DAYS_WEEKDAYS 0x3Eu
+#define SCHED_MIN_PER_DAY 1440u
+
+#define SCHED_ITEM(min, int2b, set) \
+    ((uint16_t)((min) | ((uint16_t)(int2b) << 11) | ((uint16_t)(set) << 13)))
+#define SCHED_ITEM_MIN(it) ((uint16_t)((it) & 0x07FFu))
+#define SCHED_ITEM_INT(it) ((uint8_t)(((it) >> 11) & 0x03u))
+#define SCHED_ITEM_SET(it) ((uint8_t)((it) >> 13))
+
+/* Older wire forms, still accepted on writes */
+#define SCHED_RULE_LEN 4u
+#define SCHED_TIME_LEN 7u
+#define SCHED_ENTRY_LEN (SCHED_TIME_LEN + 1u)
+
+    struct sched_table
+    {
+        uint8_t count;
+        uint8_t days[SCHED_DAYSETS];
+        uint16_t items[SCHED_CAP];
+    };
 
-    /* Public API (unchanged) */
+    /* Older 4-byte rule, as written by earlier apps */
+    struct sched_rule
+    {
+        uint8_t hour;  /* 0..23 */
+        uint8_t min;   /* 0..59 */
+        uint8_t days;  /* weekday mask, non-zero */
+        uint8_t int2b; /* 0..3 */
+    };
+
+    /* Formats or converts the EEPROM area and loads the schedule into RAM */
     void sched_init_if_blank(void);
-    int sched_append(const uint8_t time7[SCHED_TIME_LEN], uint8_t intensity2b);
-    int sched_get(uint8_t index, uint8_t out_time7[SCHED_TIME_LEN], uint8_t *out_int2b);
     uint8_t sched_count(void);
+    /* index-th item in minute order */
+    int sched_get(uint8_t index, uint16_t *item);
+    uint8_t sched_days(uint8_t set);
     void sched_clear(void);
-    int sched_append_tm(const struct tm *t, uint8_t intensity2b);
-    int sched_get_tm(uint8_t index, struct tm *out_t, uint8_t *out_int2b);
+
+    /* Replace the schedule with t, sorted by minute, writing only the span
+     * of the image that changed. Returns the number of bytes rewritten,
+     * -EINVAL if t is not valid, -EIO on an EEPROM error.
+     */
+    int sched_set(const struct sched_table *t);
+
+    /* Bumped on every change to the stored schedule */
+    uint32_t sched_generation(void);
+
+    bool sched_table_valid(const struct sched_table *t);
+
+    /* Parse an image ([count][format][days][items]); len must be exact.
+     * -EMSGSIZE bad length or format, -ERANGE bad count or item.
+     */
+    int sched_table_from_image(struct sched_table *t, const uint8_t *img, uint16_t len);
+
+    /* Append an item, sharing or taking a day set for days. -ERANGE if the
+     * table is full, the item is out of range or all day sets are taken.
+     */
+    int sched_table_add(struct sched_table *t, uint16_t min, uint8_t int2b, uint8_t days);
+
+    bool sched_rule_valid(const struct sched_rule *r);
+
+    /* Hour:minute of an old absolute entry, as a minute of the day */
+    uint16_t sched_entry_minute(const uint8_t entry[SCHED_ENTRY_LEN]);
+
+    /* Earliest occurrence of any item strictly after now, at minute
+     * resolution (an item due at now's minute counts from its next day).
+     * Binary search for today's first later item, then a forward scan for
+     * one whose day set includes the day; no queue is involved.
+     * Returns 0 with *when and *int2b set, -ENOENT if nothing is scheduled.
+     * Items at the same minute: the first one wins.
+     */
+    int sched_next_fire_after(const struct tm *now, struct tm *when, uint8_t *int2b);
 
 #ifdef __cplusplus
 }
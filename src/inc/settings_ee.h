@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * ===== Zephyr settings backend (AT24C32) =====
+ *
+ * Holds everything the BT host persists (bonds, CCC configs, GATT database
+ * hash, identity) plus DIS strings, so reconnects after a reboot skip
+ * pairing and service discovery. Selected with CONFIG_SETTINGS_CUSTOM.
+ *
+ * SETTINGS_EE_BASE is an append-only log:
+ *   [0..1]  'S','E'
+ *   [2]     SETTINGS_EE_VERSION
+ *   [3]     0xFF
+ *   then records, each
+ *     [0]      name_len (1..SETTINGS_MAX_NAME_LEN); 0xFF = end of log
+ *     [1..2]   val_len, little-endian; 0 = name deleted
+ *     [3]      crc8 (CCITT) over name_len, val_len, name and value
+ *     [4..]    name (not NUL-terminated), then value
+ *
+ * The newest record for a name wins. Loading stops at the first record
+ * whose CRC does not match, so a reset during an append loses at most the
+ * record being appended.
+ *
+ * When an append does not fit, the log is compacted in place (live records
+ * slide down over dead ones) through a journal at SETTINGS_EE_JRNL_BASE:
+ * every chunk is written there, with the copy's progress, before it is
+ * written to its destination. Two slots are used alternately, each
+ *   [0]      SETTINGS_EE_JRNL_MAGIC
+ *   [1]      seq (slot = seq & 1; the newer valid slot wins)
+ *   [2..11]  rd, wr, len, done, end (u16 LE): the record being moved, its
+ *            new offset, its length, bytes already copied, and the log end
+ *   [12]     chunk length, then SETTINGS_EE_JRNL_DATA bytes of chunk
+ *   [last]   crc8 (CCITT) over the slot
+ * At boot the newest slot is replayed and the compaction finished before
+ * the log is read, so a reset mid-compaction loses nothing. Both slots are
+ * wiped to 0xFF when it completes, as they hold copies of bond keys.
+ */
+
+#define SETTINGS_EE_BASE ((uint16_t)0x0000u)
+#define SETTINGS_EE_LEN 0x0400u
+#define SETTINGS_EE_VERSION 1u
+
+#define SETTINGS_EE_HDR_LEN 4u
+#define SETTINGS_EE_REC_HDR_LEN 4u
+
+/* In the free gap between the schedule and the statistics log */
+#define SETTINGS_EE_JRNL_BASE ((uint16_t)0x0580u)
+#define SETTINGS_EE_JRNL_MAGIC 0xC5u
+#define SETTINGS_EE_JRNL_DATA 32u
+#define SETTINGS_EE_JRNL_SLOT_LEN (13u + SETTINGS_EE_JRNL_DATA + 1u)
+#define SETTINGS_EE_JRNL_LEN (2u * SETTINGS_EE_JRNL_SLOT_LEN)
+
+#ifdef __cplusplus
+}
+#endif
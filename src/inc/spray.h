@@ -8,10 +8,22 @@
 #define SP_SW_NODE DT_ALIAS(sp_sw)
 #define SP_LED_NODE DT_ALIAS(led1)
 
+/* Sequence state as returned by spray_get_state() */
+#define SPRAY_STATE_IDLE 0
+#define SPRAY_STATE_SLOW_BLINK 1
+#define SPRAY_STATE_FAST_BLINK 2
+#define SPRAY_STATE_SOLID 3
+#define SPRAY_STATE_MONITORING_CYCLE 4
+
+/* Fired on every sequence or cycle transition; may run from a timer ISR. */
+typedef void (*spray_state_cb_t)(void);
+
 int spray_init(void);
 int spray_callback(void);
 bool is_spray_cycle_active(void);
 void spray_stop(void);
 void ble_spray_caller(uint8_t state);
+uint8_t spray_get_state(void);
+void spray_set_state_callback(spray_state_cb_t cb);
 
 #endif /* SPRAY_H */
\ No newline at end of file
@@ -6,46 +6,93 @@
 /*
  * ===== Statistics storage layout (AT24C32) =====
  *
+ * Log-structured ring of blocks, one EEPROM page each. A block holds a base
+ * timestamp and then varint second-deltas, so a typical event costs 2-3
+ * bytes instead of a full date. New events are appended to the head block
+ * in place (one short page write); when it is full the next page is
+ * started, overwriting the oldest block once all pages are used. The head
+ * is found at boot by binary search over the block sequence numbers.
+ *
  * STATS_BASE (32B-aligned):
- *   [count : u8]                               // 0..STATS_CAP (<=254)
- *   [times : STATS_CAP × 7 bytes]              // contiguous
- *   [intensities : ceil(STATS_CAP/4) bytes]    // 2 bits per entry
+ *   [header : 1 page]                        // magic "ST", version, seq_base
+ *   [log    : STATS_BLOCKS x 32-byte blocks]
+ *
+ * Header (written only on format/clear):
+ *   [0..1] 'S','T'  [2] STATS_VERSION  [3] start block  [4..7] seq_base (u32 LE)
  *
- * Entry i:
- *   time      @ (STATS_TIMES_OFF + 7*i)
- *   intensity = bits [2*(i%4) .. 2*(i%4)+1] of byte @ (STATS_INT_OFF + i/4)
+ * Block (written whole when started, then appended to):
+ *   [0..3]  seq of its first event (u32 LE), 0xFFFFFFFF = blank
+ *   [4..7]  time of its first event, seconds since 2000-01-01 (u32 LE)
+ *   [8..31] events: tm_varint of (delta_s << 2 | intensity), delta from the
+ *           previous event (0 for the first); 0xFF ends the block
+ *
+ * Sequence numbers count every event since the log was formatted and are
+ * never reused. Stored events are [first_seq, head_seq) where first_seq is
+ * the first event of the oldest block; logical entry i (0 = oldest) is
+ * sequence number (first_seq + i). The first block after a format/clear is
+ * written to the start block, so clears also spread wear over the ring.
  */
 
 // ===================== CONFIG =====================
 
 // Pick a 32-byte aligned base inside the 4KB space. Example 0x0600:
 #define STATS_BASE 0x0600u
-// No magic byte; keep 0xFF as "invalid/uninitialized". Cap at 254.
-#define STATS_CAP 254u
+#define STATS_BLOCKS 63u // 63 pages of events, 24 payload bytes each
 
 #define TIME_LEN 7u
 
 // ================= Derived layout =================
-#define STATS_COUNT_OFF (STATS_BASE + 0u)
-#define STATS_TIMES_OFF (STATS_BASE + 1u)
-#define STATS_TIMES_LEN ((uint32_t)STATS_CAP * TIME_LEN)
-#define STATS_INT_OFF (STATS_TIMES_OFF + STATS_TIMES_LEN)
-#define STATS_INT_LEN ((STATS_CAP + 3u) / 4u) // ceil(N/4)
-#define STATS_TOTAL_LEN (1u + STATS_TIMES_LEN + STATS_INT_LEN)
+#define STATS_VERSION 2u
+#define STATS_HDR_OFF (STATS_BASE + 0u)
+#define STATS_HDR_LEN 32u
+#define STATS_BLK_LEN 32u
+#define STATS_BLK_HDR_LEN 8u
+// Upper bound on events per block (one byte each)
+#define STATS_BLK_MAX (STATS_BLK_LEN - STATS_BLK_HDR_LEN)
+#define STATS_LOG_OFF (STATS_BASE + STATS_HDR_LEN)
+#define STATS_LOG_LEN ((uint32_t)STATS_BLOCKS * STATS_BLK_LEN)
+#define STATS_TOTAL_LEN (STATS_HDR_LEN + STATS_LOG_LEN)
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+   /* One decoded event, as returned by stats_get_range() */
+   struct stats_entry
+   {
+      uint8_t time[TIME_LEN];
+      uint8_t int2b;
+   };
+
    void stats_init_if_blank(void);
    int stats_append(const uint8_t time[TIME_LEN], uint8_t intensity2b);
-   int stats_get(uint8_t index, uint8_t out_time[TIME_LEN], uint8_t *out_int2b);
-   uint8_t stats_count(void);
+   int stats_get(uint16_t index, uint8_t out_time[TIME_LEN], uint8_t *out_int2b);
+   uint16_t stats_count(void);
    void stats_clear(void);
 
    int stats_append_tm(const struct tm *t, uint8_t intensity2b);
-   int stats_get_tm(uint8_t index, struct tm *out_t, uint8_t *out_int2b);
+   int stats_get_tm(uint16_t index, struct tm *out_t, uint8_t *out_int2b);
+
+   /* Sequence-number view: head_seq is the total number of events ever
+    * logged (monotonic); events below first_seq were overwritten or cleared.
+    */
+   uint32_t stats_head_seq(void);
+   uint32_t stats_first_seq(void);
+   /* Both bounds from the same instant, for readers that need a pair */
+   void stats_bounds(uint32_t *first, uint32_t *head);
+   int stats_get_seq(uint32_t seq, uint8_t out_time[TIME_LEN], uint8_t *out_int2b);
+
+   /* Read up to n consecutive events starting at start_seq, one page read
+    * per block touched. Returns the number of entries written to out, 0 if
+    * start_seq is not stored.
+    */
+   uint8_t stats_get_range(uint32_t start_seq, uint8_t n, struct stats_entry out[]);
+
+   /* Bumped on every change to the stored events (append, clear, init), so
+    * readers can tell whether a copy they built is still current.
+    */
+   uint32_t stats_generation(void);
 
 #ifdef __cplusplus
 }
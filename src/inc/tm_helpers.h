@@ -9,6 +9,21 @@ void tm_to_7(const struct tm *t, uint8_t out[7]);
 void tm_from_7(struct tm *t, const uint8_t in[7]);
 int tm_cmp(const struct tm *a, const struct tm *b);
 
+/* Compact timestamps: seconds since 2000-01-01 00:00:00, wday is derived */
+uint32_t tm_to_epoch(const struct tm *t);
+void tm_from_epoch(struct tm *t, uint32_t secs);
+uint32_t tm7_to_epoch(const uint8_t in[7]);
+void tm7_from_epoch(uint8_t out[7], uint32_t secs);
+
+/* Prefix varint for timestamp deltas: 1..4 bytes holding up to 28 bits. The
+ * leading byte's high bits give the length (0xxxxxxx, 10xxxxxx, 110xxxxx,
+ * 1110xxxx), so an erased 0xFF byte never starts a value.
+ */
+#define TM_VARINT_MAX 4u
+#define TM_VARINT_LIMIT (1u << 28)
+size_t tm_varint_put(uint32_t v, uint8_t out[TM_VARINT_MAX]);
+size_t tm_varint_get(const uint8_t *in, size_t avail, uint32_t *v);
+
 static inline const char *tm_to_str(const struct tm *t, char *buf, size_t len)
 {
     /* tm_year is years since 1900, tm_mon is 0..11 */
@@ -5,3 +5,4 @@ int vbat_init(void);
 void vbat_start(void);
 void vbat_stop(void);
 int vbat_last_millivolts(void);
+uint8_t vbat_last_percent(void);
@@ -0,0 +1,162 @@
+"""Host client for the bulk L2CAP channel (bulk.h), Linux/BlueZ only.
+
+    python3 bulk_client.py AA:BB:CC:DD:EE:FF stats [since_seq]
+    python3 bulk_client.py AA:BB:CC:DD:EE:FF eeprom [addr] [len] [out.bin]
+    python3 bulk_client.py AA:BB:CC:DD:EE:FF schedule image.bin
+
+Pair with the unit first (bluetoothctl); the channel needs an encrypted
+link. Each run prints the reply size and the throughput it measured, from
+the command going out to the last body byte coming in.
+"""
+
+import ctypes, ctypes.util, errno, os, socket, struct, sys, time
+
+BULK_PSM = 0x0085
+BULK_SDU_MAX = 512
+RSP_HDR = 6  # [cmd u8][status s8][len u32]
+
+CMD_STATS = 0x01
+CMD_EEPROM = 0x02
+CMD_SCHEDULE = 0x03
+
+SETTINGS_END = 0x0400  # bond keys live below; the unit refuses that range
+ST_PREFIX = 8  # [start_seq u32][head_seq u32]
+ST_ENTRY = 8  # [time7][intensity]
+
+# linux/bluetooth.h, l2cap.h
+SOL_BLUETOOTH = 274
+BT_SECURITY = 4
+BT_SECURITY_MEDIUM = 2
+BT_RCVMTU = 13
+BDADDR_LE_PUBLIC = 1
+BDADDR_LE_RANDOM = 2
+
+
+class SockaddrL2(ctypes.Structure):
+    _fields_ = [
+        ("l2_family", ctypes.c_ushort),
+        ("l2_psm", ctypes.c_ushort),
+        ("l2_bdaddr", ctypes.c_ubyte * 6),
+        ("l2_cid", ctypes.c_ushort),
+        ("l2_bdaddr_type", ctypes.c_ubyte),
+    ]
+
+
+def connect_le(address: str, addr_type: int) -> socket.socket:
+    """Python's own sockaddr_l2 has no address type, so connect through libc."""
+    s = socket.socket(socket.AF_BLUETOOTH, socket.SOCK_SEQPACKET, socket.BTPROTO_L2CAP)
+    s.setsockopt(SOL_BLUETOOTH, BT_SECURITY, struct.pack("BB", BT_SECURITY_MEDIUM, 0))
+    s.setsockopt(SOL_BLUETOOTH, BT_RCVMTU, struct.pack("H", BULK_SDU_MAX))
+
+    sa = SockaddrL2()
+    sa.l2_family = socket.AF_BLUETOOTH
+    sa.l2_psm = BULK_PSM  # little-endian host
+    sa.l2_bdaddr[:] = bytes(int(x, 16) for x in reversed(address.split(":")))
+    sa.l2_bdaddr_type = addr_type
+
+    libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+    if libc.connect(s.fileno(), ctypes.byref(sa), ctypes.sizeof(sa)) != 0:
+        err = ctypes.get_errno()
+        s.close()
+        raise OSError(err, f"connect {address} psm 0x{BULK_PSM:04x}: {os.strerror(err)}")
+    return s
+
+
+def transact(s: socket.socket, cmd: bytes):
+    """Send one command SDU and collect the reply stream. Returns
+    (status, body, seconds)."""
+    t0 = time.monotonic()
+    s.send(cmd)
+
+    buf = bytearray()
+    need = RSP_HDR
+    while len(buf) < need:
+        sdu = s.recv(BULK_SDU_MAX)
+        if not sdu:
+            raise ConnectionError(f"channel closed after {len(buf)} of {need} bytes")
+        buf += sdu
+        if need == RSP_HDR and len(buf) >= RSP_HDR:
+            rcmd, status, length = struct.unpack_from("<BbI", buf, 0)
+            if rcmd != cmd[0]:
+                raise ValueError(f"reply for cmd 0x{rcmd:02x}, sent 0x{cmd[0]:02x}")
+            need = RSP_HDR + length
+    dt = time.monotonic() - t0
+    return status, bytes(buf[RSP_HDR:need]), dt
+
+
+def report(status: int, body: bytes, dt: float):
+    if status:
+        print(f"refused: {errno.errorcode.get(-status, status)} ({status})")
+        return False
+    rate = len(body) / dt if dt > 0 else 0.0
+    print(f"{len(body)} body bytes in {dt * 1000:.0f} ms: {rate / 1024:.1f} KiB/s")
+    return True
+
+
+def do_stats(s, since: int):
+    status, body, dt = transact(s, struct.pack("<BI", CMD_STATS, since))
+    if not report(status, body, dt):
+        return
+    start, head = struct.unpack_from("<II", body, 0)
+    entries = body[ST_PREFIX:]
+    lost = sum(1 for i in range(0, len(entries), ST_ENTRY) if not any(entries[i : i + ST_ENTRY]))
+    print(f"seq {start}..{head}: {len(entries) // ST_ENTRY} events", end="")
+    if start > since:
+        print(f", {start - since} overwritten before the export", end="")
+    if lost:
+        print(f", {lost} overwritten during it", end="")
+    print()
+    for i in range(0, len(entries), ST_ENTRY):
+        e = entries[i : i + ST_ENTRY]
+        if any(e):
+            sec, mi, hr, md, wd, mon, yr = e[:7]
+            print(
+                f"  #{start + i // ST_ENTRY:<8d} state={e[7] & 3}  "
+                f"{1900 + yr:04d}-{mon + 1:02d}-{md:02d} {hr:02d}:{mi:02d}:{sec:02d}"
+            )
+
+
+def do_eeprom(s, addr: int, length: int, out: str):
+    status, body, dt = transact(s, struct.pack("<BHH", CMD_EEPROM, addr, length))
+    if not report(status, body, dt):
+        return
+    with open(out, "wb") as f:
+        f.write(body)
+    print(f"0x{addr:04x}..0x{addr + len(body):04x} written to {out}")
+
+
+def do_schedule(s, path: str):
+    with open(path, "rb") as f:
+        image = f.read()
+    status, body, dt = transact(s, bytes([CMD_SCHEDULE]) + image)
+    if report(status, body, dt):
+        print("queued; the commit result follows on Write Status")
+
+
+def main(argv):
+    if len(argv) < 3:
+        print(__doc__)
+        return 2
+    address, op, args = argv[1], argv[2], argv[3:]
+    addr_type = BDADDR_LE_RANDOM if os.environ.get("BULK_RANDOM_ADDR") else BDADDR_LE_PUBLIC
+
+    s = connect_le(address, addr_type)
+    try:
+        if op == "stats":
+            do_stats(s, int(args[0], 0) if args else 0)
+        elif op == "eeprom":
+            addr = int(args[0], 0) if args else SETTINGS_END
+            length = int(args[1], 0) if len(args) > 1 else 0
+            do_eeprom(s, addr, length, args[2] if len(args) > 2 else "eeprom.bin")
+        elif op == "schedule" and args:
+            do_schedule(s, args[0])
+        else:
+            print(__doc__)
+            return 2
+    finally:
+        s.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
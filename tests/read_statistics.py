@@ -1,35 +1,128 @@
-import asyncio, traceback
+import asyncio, struct, sys, traceback
+from datetime import datetime, timedelta
 from bleak import BleakClient, BleakScanner
 
 UUID_STATS_CHAR = "00004003-1212-efde-1523-785feabcd123".lower()
 PREFERRED_NAME = None
 CONNECT_TIMEOUT = 10.0
 
+# Windowed read: events from START_SEQ (clamped to what is stored), up to
+# WINDOW of them (1..63). Delta sync instead when SINCE_SEQ is set, e.g. the
+# head_seq printed by the previous run; 0 fetches everything stored.
+START_SEQ = 0
+WINDOW = 63
+SINCE_SEQ = None
 
-def decode_stats(payload: bytes):
-    if len(payload) != 9:
-        raise ValueError(f"Expected 9 bytes, got {len(payload)}")
-    meta = (payload[0] << 8) | payload[1]
-    count = meta & 0x3FFF
-    state = (meta >> 14) & 0x3
-    sec, minute, hour = payload[2], payload[3], payload[4]
-    mday, wday, mon, year_off = payload[5], payload[6], payload[7], payload[8]
+ST_HDR = 11  # [count u16][want u8][start_seq u32][head_seq u32]
+ST_ENTRY = 8  # [time7][intensity]
+SY_HDR = 9  # [start_seq u32][head_seq u32][n u8]
+EPOCH0 = datetime(2000, 1, 1)
+
+
+def decode_time7(t: bytes):
+    # [sec][min][hour][mday][wday][mon 0..11][year since 1900]
+    sec, minute, hour, mday, wday, mon, year = t[:7]
+    return {
+        "year": 1900 + year,
+        "month": mon + 1,
+        "day": mday,
+        "hour": hour,
+        "minute": minute,
+        "second": sec,
+        "wday": wday,
+    }
+
+
+def fmt_ts(ts) -> str:
+    return (
+        f"{ts['year']:04d}-{ts['month']:02d}-{ts['day']:02d} "
+        f"{ts['hour']:02d}:{ts['minute']:02d}:{ts['second']:02d} (wday={ts['wday']})"
+    )
+
+
+def decode_entries(body: bytes, start_seq: int):
+    events = []
+    for i in range(0, len(body) - len(body) % ST_ENTRY, ST_ENTRY):
+        e = body[i : i + ST_ENTRY]
+        events.append(
+            {
+                "seq": start_seq + i // ST_ENTRY,
+                "state": e[7] & 0x03,
+                "timestamp": decode_time7(e),
+                "blank": not any(e),  # overwritten while a bulk export ran
+            }
+        )
+    return events
+
+
+def decode_window(payload: bytes):
+    if len(payload) < ST_HDR:
+        raise ValueError(f"Expected at least {ST_HDR} bytes, got {len(payload)}")
+    count, want, start_seq, head_seq = struct.unpack_from("<HBII", payload, 0)
+    if len(payload) != ST_HDR + want * ST_ENTRY:
+        raise ValueError(f"Header says {want} entries, payload is {len(payload)} bytes")
     return {
         "count": count,
-        "state": state,
-        "timestamp": {
-            "year": 2000 + year_off,
-            "month": mon + 1,
-            "day": mday,
-            "hour": hour,
-            "minute": minute,
-            "second": sec,
-            "wday": wday,
-        },
-        "raw": payload.hex(" "),
+        "start_seq": start_seq,
+        "head_seq": head_seq,
+        "events": decode_entries(payload[ST_HDR:], start_seq),
     }
 
 
+def varint_get(b: bytes, off: int):
+    """Prefix varint (tm_helpers.h): the lead byte's high bits give the length."""
+    b0 = b[off]
+    if b0 & 0x80 == 0:
+        n, acc = 1, b0
+    elif b0 & 0xC0 == 0x80:
+        n, acc = 2, b0 & 0x3F
+    elif b0 & 0xE0 == 0xC0:
+        n, acc = 3, b0 & 0x1F
+    elif b0 & 0xF0 == 0xE0:
+        n, acc = 4, b0 & 0x0F
+    else:
+        raise ValueError(f"Bad varint lead byte 0x{b0:02x} at {off}")
+    if off + n > len(b):
+        raise ValueError("Varint runs past the payload")
+    for k in range(1, n):
+        acc = (acc << 8) | b[off + k]
+    return acc, off + n
+
+
+def epoch_to_ts(secs: int):
+    d = EPOCH0 + timedelta(seconds=secs)
+    return {
+        "year": d.year,
+        "month": d.month,
+        "day": d.day,
+        "hour": d.hour,
+        "minute": d.minute,
+        "second": d.second,
+        "wday": (d.weekday() + 1) % 7,  # 0 = Sunday, as on the RTC
+    }
+
+
+def decode_sync(payload: bytes):
+    if len(payload) < SY_HDR:
+        raise ValueError(f"Expected at least {SY_HDR} bytes, got {len(payload)}")
+    start_seq, head_seq, n = struct.unpack_from("<IIB", payload, 0)
+    events = []
+    off = SY_HDR
+    if n:
+        (when,) = struct.unpack_from("<I", payload, off)
+        off += 4
+        for i in range(n):
+            v, off = varint_get(payload, off)
+            zz = v >> 2
+            when += (zz >> 1) ^ -(zz & 1)
+            events.append(
+                {"seq": start_seq + i, "state": v & 0x03, "timestamp": epoch_to_ts(when)}
+            )
+    if off != len(payload):
+        raise ValueError(f"{len(payload) - off} trailing bytes after {n} events")
+    return {"start_seq": start_seq, "head_seq": head_seq, "events": events}
+
+
 async def pick_device():
     print("Scanning for 5s…")
     devices = await BleakScanner.discover(timeout=5.0)
@@ -53,8 +146,41 @@ async def pick_device():
         print("Invalid choice.")
 
 
+def print_events(events):
+    for ev in events:
+        note = "  (overwritten)" if ev.get("blank") else ""
+        print(f"  #{ev['seq']:<8d} state={ev['state']}  {fmt_ts(ev['timestamp'])}{note}")
+
+
+async def read_window(client, char):
+    await client.write_gatt_char(char, struct.pack("<IB", START_SEQ, WINDOW), response=True)
+    stats = decode_window(await client.read_gatt_char(char))
+
+    print("\n=== Statistics ===")
+    print(f"Stored : {stats['count']}")
+    print(f"Seq    : {stats['start_seq']}..{stats['head_seq']} (head = total ever logged)")
+    print_events(stats["events"])
+
+
+async def read_sync(client, char):
+    since = SINCE_SEQ
+    print("\n=== Delta sync ===")
+    while True:
+        await client.write_gatt_char(char, struct.pack("<I", since), response=True)
+        payload = await client.read_gatt_char(char)
+        sync = decode_sync(payload)
+        if sync["start_seq"] > since:
+            print(f"  ({sync['start_seq'] - since} events overwritten before this sync)")
+        print_events(sync["events"])
+        print(f"  [{len(payload)} bytes for {len(sync['events'])} events]")
+
+        since = sync["start_seq"] + len(sync["events"])
+        if since >= sync["head_seq"] or not sync["events"]:
+            break
+    print(f"Head   : {since} (pass as SINCE_SEQ next time)")
+
+
 async def read_stats(address: str):
-    # adapter=ADAPTER is harmless on other OSes; remove if you don’t need it
     async with BleakClient(address, timeout=CONNECT_TIMEOUT) as client:
         if not client.is_connected:
             raise RuntimeError(
@@ -86,23 +212,15 @@ async def read_stats(address: str):
                 f"Characteristic {UUID_STATS_CHAR} not found. Check your firmware UUID."
             )
 
-        if "read" not in target_char.properties:
+        if "read" not in target_char.properties or "write" not in target_char.properties:
             raise RuntimeError(
-                f"Characteristic {target_char.uuid} is not readable (props={target_char.properties})."
+                f"Characteristic {target_char.uuid} needs read and write (props={target_char.properties})."
             )
 
-        payload = await client.read_gatt_char(target_char)
-        stats = decode_stats(payload)
-
-        print("\n=== Statistics ===")
-        print(f"Count : {stats['count']}")
-        print(f"State : {stats['state']}")
-        ts = stats["timestamp"]
-        print(
-            f"Time  : {ts['year']:04d}-{ts['month']:02d}-{ts['day']:02d} "
-            f"{ts['hour']:02d}:{ts['minute']:02d}:{ts['second']:02d} (wday={ts['wday']})"
-        )
-        print(f"Raw   : {stats['raw']}")
+        if SINCE_SEQ is None:
+            await read_window(client, target_char)
+        else:
+            await read_sync(client, target_char)
 
 
 async def main():
@@ -121,4 +239,6 @@ async def main():
 
 if __name__ == "__main__":
     # import logging; logging.basicConfig(level=logging.DEBUG)
+    if len(sys.argv) > 1:
+        SINCE_SEQ = int(sys.argv[1], 0)
     asyncio.run(main())